@@ -3,6 +3,16 @@
 #include <linux/usb.h>
 #include <linux/slab.h>
 #include <linux/leds.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/list.h>
+#include <linux/netlink.h>
+#include <linux/notifier.h>
+#include <net/genetlink.h>
+
+#include "smartlamp_netlink.h"
 
 MODULE_AUTHOR("DevTITANS <devtitans@icomp.ufam.edu.br>");
 MODULE_DESCRIPTION("Driver de acesso ao SmartLamp (ESP32 com Chip Serial CP2102");
@@ -11,33 +21,267 @@ MODULE_LICENSE("GPL");
 
 #define MAX_RECV_LINE 100 // Tamanho máximo de uma linha de resposta do dispositvo USB
 
+#define HELLO_WINDOW_MS   1500 // Tempo total do handshake: cobre o boot do ESP32 (o DHT é detectado depois)
+#define HELLO_TIMEOUT_MS  100  // Espera inicial pela resposta de cada HELLO; dobra a cada reenvio
+#define HELLO_MAX_WAIT_MS 1000 // Limite da espera por HELLO (evita encher a serial do ESP32 de reenvios)
+#define FLUSH_TIMEOUT_MS  10  // Tempo de espera por pacote ao descartar dados antigos da serial
+#define FLUSH_MAX_PACKETS 64  // Limite de pacotes descartados (evita laço infinito se o firmware não parar de falar)
+#define DHT_TIMEOUT_MS    500 // Orçamento dos comandos que leem o DHT11, mais lentos que os demais
+#define SERIAL_TIMEOUT_MS 1200 // Timeout da Serial.readString() do firmware antigo (1 s) mais uma folga
+#define RECOVERY_MAX_MS   30000 // Intervalo máximo entre tentativas de reconexão com o circuito aberto
+#define MIN_SAMPLE_MS     50  // Menor período de amostragem que um assinante netlink pode pedir
+#define CAPS_POLL_MS      500 // Intervalo entre GET_CAPS enquanto o firmware ainda detecta o DHT
+#define CAPS_MAX_POLLS    20  // Desiste de esperar a detecção depois de CAPS_MAX_POLLS consultas
+
+// Sensores anunciados pelo firmware na resposta "RES HELLO <versao> <sensores> <recursos>"
+#define SENSOR_LDR  (1 << 0)
+#define SENSOR_TEMP (1 << 1)
+#define SENSOR_HUM  (1 << 2)
+#define SENSOR_ALL  (SENSOR_LDR | SENSOR_TEMP | SENSOR_HUM)
+#define SENSOR_PENDING (1 << 7) // Firmware ainda detectando o DHT: consultar de novo com GET_CAPS
+
+// Recursos do protocolo anunciados pelo firmware
+#define FEATURE_LINE_CMDS (1 << 0) // Comandos terminados em '\n' são respondidos sem esperar o timeout da serial
+#define FEATURE_TIME_SYNC (1 << 1) // Firmware responde TIME_SYNC e carimba as amostras com o próprio relógio
+
+#define TIME_SYNC_ROUNDS    8           // Trocas por sincronização; vale a de menor tempo de ida e volta
+#define TIME_SYNC_MIN_SPAN  (10 * NSEC_PER_SEC) // Intervalo mínimo entre referências para estimar a deriva
+#define TIME_SYNC_MAX_SPAN  (3600 * NSEC_PER_SEC) // Acima disso a base avança (mantém as contas da deriva em 64 bits)
+#define TIME_SYNC_MAX_DRIFT 1000000     // Deriva máxima aceita em ppb (1000 ppm)
+
+// Estatísticas por sensor: cada janela é dividida em STAT_BUCKETS baldes de tempo.
+// Um novo valor só atualiza o balde atual e os acumuladores da janela (O(1));
+// o mínimo/máximo da janela só é recalculado quando um balde expira (uma vez por balde).
+// As janelas são fixas na compilação: os nomes dos arquivos do sysfs (<sensor>_mean_60s, ...) as citam.
+#define STAT_BUCKETS    60
+#define STAT_WINDOWS    2
+#define STAT_SHORT_S    60   // Janela curta (baldes de 1 s)
+#define STAT_LONG_S     3600 // Janela longa (baldes de 60 s)
+#define EWMA_SHIFT      3  // Peso de cada nova amostra na média móvel exponencial: 1/8
+#define EWMA_FRAC       10 // Bits fracionários da média móvel exponencial
+
+enum { STAT_LDR, STAT_TEMP, STAT_HUM, STAT_SENSORS };
+enum { STAT_MIN, STAT_MAX, STAT_MEAN, STAT_EWMA, STAT_TS };
+
+struct stat_bucket {
+    s64 sum;
+    u32 count;
+    int min, max;
+};
+
+struct stat_window {
+    unsigned int bucket_s;           // Duração de cada balde em segundos
+    u64 epoch;                       // Índice (tempo / bucket_s) do balde mais recente
+    s64 sum;                         // Soma e quantidade de amostras de todos os baldes da janela
+    u32 count;
+    int min, max;                    // Mínimo e máximo da janela (válidos se count > 0)
+    struct stat_bucket buckets[STAT_BUCKETS];
+};
+
+struct sensor_stats {
+    struct stat_window win[STAT_WINDOWS];
+    s64 ewma;                        // Média móvel exponencial com EWMA_FRAC bits fracionários
+    bool has_ewma;
+    int last;                        // Último valor lido com sucesso, servido quando o dispositivo não responde
+    ktime_t last_ts;                 // Instante de aquisição do último valor, no CLOCK_MONOTONIC do host
+    bool has_last;
+};
+
+// Relação entre o relógio do ESP32 e o CLOCK_MONOTONIC do host, estimada pelas trocas TIME_SYNC.
+// Cada ponto associa um instante do dispositivo ao ponto médio (envio + recepção) / 2 no host.
+struct time_sync_state {
+    bool valid;
+    s64 dev_ref, host_ref;           // Base para a deriva: no máximo TIME_SYNC_MAX_SPAN atrás
+    s64 dev_next, host_next;         // Próxima base, escolhida quando a atual passa da metade do limite
+    bool has_next;
+    s64 dev_last, host_last;         // Ponto mais recente (base para a conversão)
+    s64 offset_ns;                   // dev_last - host_last
+    s64 drift_ppb;                   // Quanto o relógio do ESP32 adianta em relação ao host (partes por bilhão)
+    s64 rtt_ns;                      // Tempo de ida e volta da melhor troca da última sincronização
+};
+
+// Atributo do sysfs com os dados necessários para localizar a estatística sem comparar nomes
+struct stat_attribute {
+    struct kobj_attribute attr;
+    int sensor, kind, window;
+};
+
+static const unsigned int stat_bucket_s[STAT_WINDOWS] = { STAT_SHORT_S / STAT_BUCKETS, STAT_LONG_S / STAT_BUCKETS };
+static struct sensor_stats stats[STAT_SENSORS];    // Estatísticas de ldr, temp e hum
+static DEFINE_SPINLOCK(stats_lock);                // Protege stats entre o worker de amostragem e o sysfs
+
+static unsigned int sample_ms = 1000;              // Período de amostragem contínua dos sensores
+module_param(sample_ms, uint, 0644);
+MODULE_PARM_DESC(sample_ms, "Periodo de amostragem dos sensores em ms para as estatisticas (0 desativa)");
+
+static unsigned int cmd_timeout_ms = 250;          // Prazo total de um comando (escrita + resposta)
+module_param(cmd_timeout_ms, uint, 0644);
+MODULE_PARM_DESC(cmd_timeout_ms, "Prazo em ms para a resposta de um comando (GET_TEMP/GET_HUM usam no minimo 500; firmware antigo soma 1200)");
+
+static unsigned int breaker_threshold = 3;         // Falhas seguidas que abrem o circuito
+module_param(breaker_threshold, uint, 0644);
+MODULE_PARM_DESC(breaker_threshold, "Falhas consecutivas ate o driver parar de esperar pelo dispositivo");
+
+static unsigned int time_sync_ms = 60000;          // Período de ressincronização dos relógios
+module_param(time_sync_ms, uint, 0644);
+MODULE_PARM_DESC(time_sync_ms, "Periodo em ms entre sincronizacoes de relogio com o firmware (0 desativa)");
+
+static bool serve_stale;                           // Com o circuito aberto, devolve o último valor em vez de erro
+module_param(serve_stale, bool, 0644);
+MODULE_PARM_DESC(serve_stale, "Com o dispositivo sem responder, le o ultimo valor conhecido em vez de retornar -EIO");
+
+// Circuit breaker: depois de breaker_threshold falhas seguidas os comandos falham na hora,
+// sem tocar na USB, até que recovery_work consiga falar com o dispositivo de novo.
+static unsigned int breaker_failures;              // Falhas consecutivas de comandos
+static bool breaker_open;                          // true = dispositivo considerado fora do ar
+static unsigned int recovery_ms;                   // Intervalo atual entre tentativas de reconexão (dobra a cada falha)
+
+// Período de amostragem pedido por um assinante netlink (identificado pela porta do socket)
+struct rate_request {
+    struct list_head list;
+    u32 portid;
+    unsigned int period_ms;
+};
+static LIST_HEAD(rate_requests);
+static DEFINE_MUTEX(rate_mutex);                   // Protege rate_requests e sampling
+static unsigned int subscriber_ms;                 // Menor período pedido pelos assinantes (0 = nenhum pedido)
+static bool sampling;                              // true enquanto há dispositivo e sample_work pode ser agendado
+static char smartlamp_dev_name[32];                // Nome do dispositivo USB, enviado em cada mensagem netlink
+
+static struct time_sync_state time_sync_state;
+static DEFINE_SPINLOCK(time_sync_lock);            // Protege time_sync_state entre a sincronização, os comandos e o sysfs
+
 
 static char recv_line[MAX_RECV_LINE];              // Armazena dados vindos da USB até receber um caractere de nova linha '\n'
+static int recv_len;                               // Quantidade de caracteres já acumulados em recv_line
 static struct usb_device *smartlamp_device;        // Referência para o dispositivo USB
 static uint usb_in, usb_out;                       // Endereços das portas de entrada e saida da USB
 static char *usb_in_buffer, *usb_out_buffer;       // Buffers de entrada e saída da USB
+static int usb_in_len, usb_in_pos;                 // Bytes recebidos em usb_in_buffer e quantos já foram consumidos
+static bool usb_stale_input;                       // Um comando desistiu da resposta: ela ainda pode chegar atrasada
 static int usb_max_size;                           // Tamanho máximo de uma mensagem USB
 
+static int fw_version = -1;                        // Versão do firmware (0 = firmware antigo, sem HELLO)
+static int fw_sensors;                             // Sensores presentes no dispositivo (SENSOR_*)
+static bool caps_pending;                          // HELLO anunciou SENSOR_PENDING: mais sensores podem aparecer
+static int caps_polls;                             // GET_CAPS já enviados desde a conexão
+static int fw_features;                            // Recursos do protocolo suportados (FEATURE_*)
+static ktime_t probe_start;                        // Instante em que o dispositivo foi conectado
+static s64 handshake_us = -1;                      // Duração do handshake HELLO/CAPS
+static s64 first_read_us = -1;                     // Tempo entre a conexão e a primeira leitura válida
+
 #define VENDOR_ID   0x10c4 /* Encontre o VendorID  do smartlamp */
 #define PRODUCT_ID   0xea60  /* Encontre o ProductID do smartlamp */
 static const struct usb_device_id id_table[] = { { USB_DEVICE(VENDOR_ID, PRODUCT_ID) }, {} };
 
 static int  usb_probe(struct usb_interface *ifce, const struct usb_device_id *id); // Executado quando o dispositivo é conectado na USB
 static void usb_disconnect(struct usb_interface *ifce);                           // Executado quando o dispositivo USB é desconectado da USB
-static int  usb_read_serial(int);
-static int usb_send_cmd(char *cmd, int param); // Declaração antecipada
+static int  usb_send_cmd(const char *cmd, int *value);                            // Envia um comando e devolve o valor da resposta em value
+static int  usb_send_cmd_ts(const char *cmd, int *value, ktime_t *when);          // Idem, devolvendo também o instante de aquisição
+static int  smartlamp_handshake(void);                                            // Descobre versão, sensores e recursos do firmware
+static void sample_work_fn(struct work_struct *work);                             // Lê periodicamente os sensores e alimenta as estatísticas
+static DECLARE_DELAYED_WORK(sample_work, sample_work_fn);
+static void stats_reset(void);                                                    // Zera as estatísticas de todos os sensores
+static void stats_add(int sensor, int value, ktime_t when);                       // Acrescenta uma amostra às estatísticas do sensor
+static unsigned int sample_period_ms(void);                                       // Período efetivo entre sample_ms e os assinantes netlink
+static void smartlamp_nl_sample(const char *sensor, int value, ktime_t when);     // Publica uma amostra no grupo multicast
+static void smartlamp_nl_event(u32 event);                                        // Publica uma mudança de estado no grupo multicast
+static int  smartlamp_nl_set_rate(struct sk_buff *skb, struct genl_info *info);   // Pedido de período de amostragem de um assinante
+static int  smartlamp_nl_notify(struct notifier_block *nb, unsigned long event, void *ptr);
+static void stats_set_last(int sensor, int value, ktime_t when);                  // Guarda o último valor lido do sensor
+static int  stats_get_last(int sensor, int *value);                               // Devolve o último valor lido do sensor
+static DEFINE_MUTEX(usb_mutex);                                                   // Serializa os comandos na USB (sysfs, LED e worker)
+static void recovery_work_fn(struct work_struct *work);                           // Testa o dispositivo em segundo plano com o circuito aberto
+static DECLARE_DELAYED_WORK(recovery_work, recovery_work_fn);
+static int  time_sync(void);                                                      // Estima offset e deriva do relógio do ESP32
+static void time_sync_work_fn(struct work_struct *work);                          // Ressincroniza os relógios a cada time_sync_ms
+static DECLARE_DELAYED_WORK(time_sync_work, time_sync_work_fn);
+static void caps_work_fn(struct work_struct *work);                               // Acrescenta os sensores que o firmware detectou depois do HELLO
+static DECLARE_DELAYED_WORK(caps_work, caps_work_fn);
 
 // Executado quando o arquivo /sys/kernel/smartlamp/{led, ldr} é lido (e.g., cat /sys/kernel/smartlamp/led)
 static ssize_t attr_show(struct kobject *sys_obj, struct kobj_attribute *attr, char *buff);
 // Executado quando o arquivo /sys/kernel/smartlamp/{led, ldr} é escrito (e.g., echo "100" | sudo tee -a /sys/kernel/smartlamp/led)
 static ssize_t attr_store(struct kobject *sys_obj, struct kobj_attribute *attr, const char *buff, size_t count);
+// Executado quando os arquivos informativos /sys/kernel/smartlamp/{fw_version, sensors, ...} são lidos
+static ssize_t info_show(struct kobject *sys_obj, struct kobj_attribute *attr, char *buff);
+// Executado quando as estatísticas /sys/kernel/smartlamp/<sensor>_<min|max|mean>_<janela>s são lidas
+static ssize_t stat_show(struct kobject *sys_obj, struct kobj_attribute *attr, char *buff);
 // Variáveis para criar os arquivos no /sys/kernel/smartlamp/{led, ldr}
 static struct kobj_attribute  led_attribute = __ATTR(led, S_IRUGO | S_IWUSR, attr_show, attr_store);
 static struct kobj_attribute  ldr_attribute = __ATTR(ldr, S_IRUGO | S_IWUSR, attr_show, attr_store);
 static struct kobj_attribute  temp_attribute = __ATTR(temp, S_IRUGO | S_IWUSR, attr_show, attr_store);
 static struct kobj_attribute  hum_attribute = __ATTR(hum, S_IRUGO | S_IWUSR, attr_show, attr_store);
-static struct attribute      *attrs[]       = { &led_attribute.attr, &ldr_attribute.attr, &temp_attribute.attr, &hum_attribute.attr, NULL };
+static struct kobj_attribute  fw_version_attribute = __ATTR(fw_version, S_IRUGO, info_show, NULL);
+static struct kobj_attribute  sensors_attribute = __ATTR(sensors, S_IRUGO, info_show, NULL);
+static struct kobj_attribute  features_attribute = __ATTR(features, S_IRUGO, info_show, NULL);
+static struct kobj_attribute  handshake_us_attribute = __ATTR(handshake_us, S_IRUGO, info_show, NULL);
+static struct kobj_attribute  first_read_us_attribute = __ATTR(first_read_us, S_IRUGO, info_show, NULL);
+static struct kobj_attribute  breaker_attribute = __ATTR(breaker, S_IRUGO, info_show, NULL);
+static struct kobj_attribute  time_sync_attribute = __ATTR(time_sync, S_IRUGO, info_show, NULL);
+static struct attribute      *attrs[]       = { &led_attribute.attr, &fw_version_attribute.attr, &sensors_attribute.attr,
+                                                &features_attribute.attr, &handshake_us_attribute.attr,
+                                                &first_read_us_attribute.attr, &breaker_attribute.attr,
+                                                &time_sync_attribute.attr, NULL };
 static struct attribute_group attr_group    = { .attrs = attrs };
+// Estatísticas somente leitura: consultas são leituras de memória, sem tráfego na USB
+#define STAT_ATTR(_name, _sensor, _kind, _window) \
+    static struct stat_attribute _name##_attribute = { \
+        .attr = __ATTR(_name, S_IRUGO, stat_show, NULL), .sensor = _sensor, .kind = _kind, .window = _window }
+STAT_ATTR(ldr_min_60s,     STAT_LDR,  STAT_MIN,  0);
+STAT_ATTR(ldr_max_60s,     STAT_LDR,  STAT_MAX,  0);
+STAT_ATTR(ldr_mean_60s,    STAT_LDR,  STAT_MEAN, 0);
+STAT_ATTR(ldr_min_3600s,   STAT_LDR,  STAT_MIN,  1);
+STAT_ATTR(ldr_max_3600s,   STAT_LDR,  STAT_MAX,  1);
+STAT_ATTR(ldr_mean_3600s,  STAT_LDR,  STAT_MEAN, 1);
+STAT_ATTR(ldr_ewma,        STAT_LDR,  STAT_EWMA, -1);
+STAT_ATTR(ldr_ts,          STAT_LDR,  STAT_TS,   -1);
+STAT_ATTR(temp_min_60s,    STAT_TEMP, STAT_MIN,  0);
+STAT_ATTR(temp_max_60s,    STAT_TEMP, STAT_MAX,  0);
+STAT_ATTR(temp_mean_60s,   STAT_TEMP, STAT_MEAN, 0);
+STAT_ATTR(temp_min_3600s,  STAT_TEMP, STAT_MIN,  1);
+STAT_ATTR(temp_max_3600s,  STAT_TEMP, STAT_MAX,  1);
+STAT_ATTR(temp_mean_3600s, STAT_TEMP, STAT_MEAN, 1);
+STAT_ATTR(temp_ewma,       STAT_TEMP, STAT_EWMA, -1);
+STAT_ATTR(temp_ts,         STAT_TEMP, STAT_TS,   -1);
+STAT_ATTR(hum_min_60s,     STAT_HUM,  STAT_MIN,  0);
+STAT_ATTR(hum_max_60s,     STAT_HUM,  STAT_MAX,  0);
+STAT_ATTR(hum_mean_60s,    STAT_HUM,  STAT_MEAN, 0);
+STAT_ATTR(hum_min_3600s,   STAT_HUM,  STAT_MIN,  1);
+STAT_ATTR(hum_max_3600s,   STAT_HUM,  STAT_MAX,  1);
+STAT_ATTR(hum_mean_3600s,  STAT_HUM,  STAT_MEAN, 1);
+STAT_ATTR(hum_ewma,        STAT_HUM,  STAT_EWMA, -1);
+STAT_ATTR(hum_ts,          STAT_HUM,  STAT_TS,   -1);
+// Cada sensor tem seu próprio grupo, criado apenas se o firmware anunciar o sensor no HELLO
+static struct attribute      *ldr_attrs[]   = { &ldr_attribute.attr,
+                                                &ldr_min_60s_attribute.attr.attr, &ldr_max_60s_attribute.attr.attr,
+                                                &ldr_mean_60s_attribute.attr.attr, &ldr_min_3600s_attribute.attr.attr,
+                                                &ldr_max_3600s_attribute.attr.attr, &ldr_mean_3600s_attribute.attr.attr,
+                                                &ldr_ewma_attribute.attr.attr, &ldr_ts_attribute.attr.attr, NULL };
+static struct attribute      *temp_attrs[]  = { &temp_attribute.attr,
+                                                &temp_min_60s_attribute.attr.attr, &temp_max_60s_attribute.attr.attr,
+                                                &temp_mean_60s_attribute.attr.attr, &temp_min_3600s_attribute.attr.attr,
+                                                &temp_max_3600s_attribute.attr.attr, &temp_mean_3600s_attribute.attr.attr,
+                                                &temp_ewma_attribute.attr.attr, &temp_ts_attribute.attr.attr, NULL };
+static struct attribute      *hum_attrs[]   = { &hum_attribute.attr,
+                                                &hum_min_60s_attribute.attr.attr, &hum_max_60s_attribute.attr.attr,
+                                                &hum_mean_60s_attribute.attr.attr, &hum_min_3600s_attribute.attr.attr,
+                                                &hum_max_3600s_attribute.attr.attr, &hum_mean_3600s_attribute.attr.attr,
+                                                &hum_ewma_attribute.attr.attr, &hum_ts_attribute.attr.attr, NULL };
+static struct attribute_group ldr_attr_group  = { .attrs = ldr_attrs };
+static struct attribute_group temp_attr_group = { .attrs = temp_attrs };
+static struct attribute_group hum_attr_group  = { .attrs = hum_attrs };
+// Indexado por STAT_*: bit anunciado no HELLO, comando de leitura e arquivos do sysfs de cada sensor
+static const struct {
+    int sensor;
+    const char *name;
+    const char *cmd;
+    const struct attribute_group *group;
+} sensor_table[STAT_SENSORS] = {
+    [STAT_LDR]  = { SENSOR_LDR,  "ldr",  "GET_LDR",  &ldr_attr_group },
+    [STAT_TEMP] = { SENSOR_TEMP, "temp", "GET_TEMP", &temp_attr_group },
+    [STAT_HUM]  = { SENSOR_HUM,  "hum",  "GET_HUM",  &hum_attr_group },
+};
 static struct kobject        *sys_obj;                                             // Executado para ler a saida da porta serial
 
 MODULE_DEVICE_TABLE(usb, id_table);
@@ -52,7 +296,43 @@ static struct usb_driver smartlamp_driver = {
     .id_table    = id_table,        // Tabela com o VendorID e ProductID do dispositivo
 };
 
-module_usb_driver(smartlamp_driver);
+// Família generic netlink: amostras e eventos para qualquer número de assinantes
+static const struct nla_policy smartlamp_genl_policy[SMARTLAMP_A_MAX + 1] = {
+    [SMARTLAMP_A_DEVICE]    = { .type = NLA_NUL_STRING },
+    [SMARTLAMP_A_SENSOR]    = { .type = NLA_NUL_STRING },
+    [SMARTLAMP_A_VALUE]     = { .type = NLA_S32 },
+    [SMARTLAMP_A_TIMESTAMP] = { .type = NLA_U64 },
+    [SMARTLAMP_A_EVENT]     = { .type = NLA_U32 },
+    [SMARTLAMP_A_PERIOD_MS] = { .type = NLA_U32 },
+};
+static const struct genl_ops smartlamp_genl_ops[] = {
+    // Só CAP_NET_ADMIN: o período vale para todos e um usuário qualquer poderia forçar 50 ms na USB
+    { .cmd = SMARTLAMP_C_SET_RATE, .doit = smartlamp_nl_set_rate, .flags = GENL_ADMIN_PERM },
+};
+static const struct genl_multicast_group smartlamp_genl_mcgrps[] = {
+    { .name = SMARTLAMP_GENL_MCGRP },
+};
+static struct genl_family smartlamp_genl_family = {
+    .name          = SMARTLAMP_GENL_NAME,
+    .version       = SMARTLAMP_GENL_VERSION,
+    .maxattr       = SMARTLAMP_A_MAX,
+    .policy        = smartlamp_genl_policy,
+    .module        = THIS_MODULE,
+    .ops           = smartlamp_genl_ops,
+    .n_ops         = ARRAY_SIZE(smartlamp_genl_ops),
+    .resv_start_op = SMARTLAMP_C_SET_RATE + 1,
+    .mcgrps        = smartlamp_genl_mcgrps,
+    .n_mcgrps      = ARRAY_SIZE(smartlamp_genl_mcgrps),
+};
+static struct notifier_block smartlamp_nl_notifier = {
+    .notifier_call = smartlamp_nl_notify,
+};
+
+// Além do driver USB, o módulo registra a família netlink: por isso não usa module_usb_driver()
+static int __init smartlamp_init(void);
+static void __exit smartlamp_exit(void);
+module_init(smartlamp_init);
+module_exit(smartlamp_exit);
 
 // Executado quando o dispositivo é conectado na USB
 static struct led_classdev *led_cdev; // Ponteiro global para liberar na desconexão
@@ -63,12 +343,14 @@ static DEFINE_MUTEX(led_mutex);
 // Função chamada ao escrever em /sys/class/leds/smartlamp_led/brightness
 void led_set_brightness(struct led_classdev *led_cdev, unsigned int brightness) {
     int value = (int)brightness;
+    int result;
     mutex_lock(&led_mutex);
     led_brightness = value;
     // Envia comando para o dispositivo via USB
     char cmd[19];
     snprintf(cmd, sizeof(cmd), "SET_LED %d", value);
-    usb_send_cmd(cmd, 2);
+    if (usb_send_cmd(cmd, &result) == 0 && result >= 0)
+        smartlamp_nl_sample("led", value, ktime_get());
     mutex_unlock(&led_mutex);
     printk(KERN_INFO "SmartLamp: LED set brightness %d\n", value);
 }
@@ -77,8 +359,9 @@ void led_set_brightness(struct led_classdev *led_cdev, unsigned int brightness)
 static enum led_brightness led_get_brightness(struct led_classdev *led_cdev) {
     int value;
     mutex_lock(&led_mutex);
-    value = usb_send_cmd("GET_LED", 1);
-    led_brightness = value;
+    if (usb_send_cmd("GET_LED", &value) == 0)
+        led_brightness = value;
+    value = led_brightness;
     mutex_unlock(&led_mutex);
     printk(KERN_INFO "SmartLamp: LED get brightness %d\n", value);
     return (enum led_brightness)value;
@@ -86,30 +369,69 @@ static enum led_brightness led_get_brightness(struct led_classdev *led_cdev) {
 
 static int usb_probe(struct usb_interface *interface, const struct usb_device_id *id) {
     struct usb_endpoint_descriptor *usb_endpoint_in, *usb_endpoint_out;
+    int ret, i, value;
+    ktime_t when;
 
     printk(KERN_INFO "SmartLamp: Dispositivo conectado ...\n");
-
-    // Cria arquivos do /sys/kernel/smartlamp/*
-    sys_obj = kobject_create_and_add("smartlamp", kernel_kobj);
-    ignore = sysfs_create_group(sys_obj, &attr_group); // AQUI
+    probe_start = ktime_get();
+    handshake_us = -1;                      // Firmware antigo não responde ao HELLO: não mostra o valor do dispositivo anterior
+    first_read_us = -1;
+    strscpy(smartlamp_dev_name, dev_name(&interface->dev), sizeof(smartlamp_dev_name));
+    breaker_failures = 0;
+    breaker_open = false;
 
     // Detecta portas e aloca buffers de entrada e saída de dados na USB
     smartlamp_device = interface_to_usbdev(interface);
-    ignore =  usb_find_common_endpoints(interface->cur_altsetting, &usb_endpoint_in, &usb_endpoint_out, NULL, NULL);  // AQUI
+    ret = usb_find_common_endpoints(interface->cur_altsetting, &usb_endpoint_in, &usb_endpoint_out, NULL, NULL);
+    if (ret) {
+        printk(KERN_ERR "SmartLamp: Endpoints bulk nao encontrados.\n");
+        return ret;
+    }
     usb_max_size = usb_endpoint_maxp(usb_endpoint_in);
     usb_in = usb_endpoint_in->bEndpointAddress;
     usb_out = usb_endpoint_out->bEndpointAddress;
     usb_in_buffer = kmalloc(usb_max_size, GFP_KERNEL);
     usb_out_buffer = kmalloc(usb_max_size, GFP_KERNEL);
+    if (!usb_in_buffer || !usb_out_buffer) {
+        kfree(usb_in_buffer);
+        kfree(usb_out_buffer);
+        return -ENOMEM;
+    }
 
-    //LDR_value = usb_read_serial(1);
-    //printk("LDR Value: %d\n", LDR_value);
+    // Descobre o que o firmware oferece antes de expor qualquer arquivo no sysfs.
+    // Firmwares antigos não conhecem o HELLO: nesse caso assume que todos os sensores existem.
+    if (smartlamp_handshake()) {
+        printk(KERN_WARNING "SmartLamp: Firmware nao respondeu ao HELLO, assumindo firmware antigo.\n");
+        fw_version = 0;
+        fw_sensors = SENSOR_ALL;
+        caps_pending = false;
+        fw_features = 0;
+    }
+
+    // Cria arquivos do /sys/kernel/smartlamp/*
+    sys_obj = kobject_create_and_add("smartlamp", kernel_kobj);
+    if (!sys_obj)
+        printk(KERN_ERR "SmartLamp: Falha ao criar /sys/kernel/smartlamp\n");
+    else if (sysfs_create_group(sys_obj, &attr_group))
+        printk(KERN_ERR "SmartLamp: Falha ao criar os arquivos do sysfs\n");
+    for (i = 0; sys_obj && i < STAT_SENSORS; i++) {
+        if (!(fw_sensors & sensor_table[i].sensor))
+            continue;
+        if (sysfs_create_group(sys_obj, sensor_table[i].group))
+            printk(KERN_ERR "SmartLamp: Falha ao criar os arquivos do sensor %s\n", sensor_table[i].cmd);
+    }
+
+    // Sincroniza os relógios antes da primeira amostra: a partir daqui o firmware carimba as amostras
+    memset(&time_sync_state, 0, sizeof(time_sync_state));
+    if (fw_features & FEATURE_TIME_SYNC)
+        time_sync();
 
     // add led to /sys/class/leds/smartlamp_led
     led_cdev = devm_kzalloc(&interface->dev, sizeof(*led_cdev), GFP_KERNEL);
     if (!led_cdev) {
         printk(KERN_ERR "SmartLamp: Falha ao alocar memória para led_classdev\n");
-        return -ENOMEM;
+        ret = -ENOMEM;
+        goto err_free;
     }
 
     led_cdev->name = "smartlamp_led";
@@ -119,130 +441,346 @@ static int usb_probe(struct usb_interface *interface, const struct usb_device_id
     // Registra o LED
     if (led_classdev_register(&interface->dev, led_cdev)) {
         printk(KERN_ERR "SmartLamp: Falha ao registrar led_classdev\n");
-        return -EINVAL;
+        ret = -EINVAL;
+        goto err_free;
     }
+
+    // Primeira leitura já no probe: first_read_us mede do hot-plug até um valor válido,
+    // e não de quando algum programa resolveu ler o sysfs
+    stats_reset();
+    for (i = 0; i < STAT_SENSORS && !(fw_sensors & sensor_table[i].sensor); i++)
+        ;
+    if (i < STAT_SENSORS) {
+        if (usb_send_cmd_ts(sensor_table[i].cmd, &value, &when) == 0)
+            stats_set_last(i, value, when);
+    } else {
+        usb_send_cmd("GET_LED", &value);
+    }
+    if (first_read_us < 0)
+        printk(KERN_WARNING "SmartLamp: Primeira leitura falhou.\n");
+
+    // Os workers só começam depois que nada mais pode falhar: um probe que falha não
+    // passa pelo usb_disconnect() e deixaria os workers rodando sem dispositivo
+    // Mesmo que a primeira sincronização falhe, a próxima tenta de novo
+    if ((fw_features & FEATURE_TIME_SYNC) && time_sync_ms)
+        schedule_delayed_work(&time_sync_work, msecs_to_jiffies(time_sync_ms));
+
+    // Começa a amostragem contínua que alimenta as estatísticas
+    mutex_lock(&rate_mutex);
+    sampling = true;
+    if (sample_period_ms())
+        schedule_delayed_work(&sample_work, 0);
+    mutex_unlock(&rate_mutex);
+
+    // O DHT é detectado pelo firmware depois do boot; os arquivos dele aparecem quando ficar pronto
+    caps_polls = 0;
+    if (caps_pending)
+        schedule_delayed_work(&caps_work, msecs_to_jiffies(CAPS_POLL_MS));
+
     printk(KERN_INFO "SmartLamp: Dispositivo conectado com sucesso.\n");
+    smartlamp_nl_event(SMARTLAMP_EV_CONNECTED);
 
     return 0;
+
+err_free:
+    // Amostragem e sincronização ainda não começaram; só o breaker pode ter agendado o
+    // recovery_work, se alguém leu o sysfs nesse meio tempo. Mesma ordem do usb_disconnect().
+    if (sys_obj) kobject_put(sys_obj);
+    sys_obj = NULL;
+    led_cdev = NULL;
+    cancel_delayed_work_sync(&recovery_work);
+    kfree(usb_in_buffer);
+    kfree(usb_out_buffer);
+    usb_in_buffer = usb_out_buffer = NULL;
+    fw_version = -1;
+    return ret;
 }
 
 // Executado quando o dispositivo USB é desconectado da USB
 static void usb_disconnect(struct usb_interface *interface) {
     printk(KERN_INFO "SmartLamp: Dispositivo desconectado.\n");
+    mutex_lock(&rate_mutex);
+    sampling = false;                       // Um SET_RATE a partir daqui não reagenda mais a amostragem
+    mutex_unlock(&rate_mutex);
+    cancel_delayed_work_sync(&sample_work); // Para a amostragem antes de liberar os buffers da USB
+    cancel_delayed_work_sync(&time_sync_work);
+    cancel_delayed_work_sync(&caps_work);    // Cria arquivos no sys_obj: para antes de removê-lo
     if (sys_obj) kobject_put(sys_obj);      // Remove os arquivos em /sys/kernel/smartlamp
+    sys_obj = NULL;
     if (led_cdev) {
         led_classdev_unregister(led_cdev);  // Remove o LED de /sys/class/leds
         // devm_kfree não é necessário, pois devm_kzalloc será limpo automaticamente
         led_cdev = NULL;
     }
+    cancel_delayed_work_sync(&recovery_work); // Sem sysfs e LED ninguém mais abre o circuito
     kfree(usb_in_buffer);                   // Desaloca buffers
     kfree(usb_out_buffer);
+    usb_in_buffer = usb_out_buffer = NULL;
+    fw_version = -1;
+    smartlamp_nl_event(SMARTLAMP_EV_DISCONNECTED);
 }
 
-// Envia um comando via USB, espera e retorna a resposta do dispositivo (convertido para int)
-// Exemplo de Comando:  SET_LED 80
-// Exemplo de Resposta: RES SET_LED 1
-// Exemplo de chamada da função usb_send_cmd para SET_LED: usb_send_cmd("SET_LED", 80);
-static int usb_send_cmd(char *cmd, int param) {
+// Milissegundos que ainda restam até deadline, ou 0 se o prazo já acabou
+static int deadline_remaining_ms(ktime_t deadline) {
+    s64 ms = ktime_ms_delta(deadline, ktime_get());
+
+    return ms > 0 ? (int)ms : 0;
+}
+
+// Escreve um comando na serial, terminado em '\n' para que o firmware responda sem esperar timeout
+static int usb_write_cmd(const char *cmd, ktime_t deadline) {
     int ret, actual_size;
-    char resp_expected[MAX_RECV_LINE];      // Resposta esperada do comando
+    int timeout_ms = deadline_remaining_ms(deadline);
+
+    if (!timeout_ms)
+        return -ETIMEDOUT;
 
-    printk(KERN_INFO "SmartLamp: Enviando comando: %s\n", cmd);
+    pr_debug("SmartLamp: Enviando comando: %s\n", cmd);
 
-    // preencha o buffer                     // Caso contrário, é só o comando mesmo
-    strcpy(usb_out_buffer, cmd);
+    snprintf(usb_out_buffer, usb_max_size, "%s\n", cmd);
     // Envia o comando (usb_out_buffer) para a USB
     // Procure a documentação da função usb_bulk_msg para entender os parâmetros
-    ret = usb_bulk_msg(smartlamp_device, usb_sndbulkpipe(smartlamp_device, usb_out), usb_out_buffer, strlen(usb_out_buffer), &actual_size, 1000);
-    if (ret) {
+    ret = usb_bulk_msg(smartlamp_device, usb_sndbulkpipe(smartlamp_device, usb_out), usb_out_buffer, strlen(usb_out_buffer), &actual_size, timeout_ms);
+    if (ret)
         printk(KERN_ERR "SmartLamp: Erro de codigo %d ao enviar comando!\n", ret);
-        return -1;
+    return ret;
+}
+
+// Lê uma linha completa da serial (sem o '\n') para line, que deve ter MAX_RECV_LINE bytes.
+// Um pacote USB pode trazer mais de uma linha: o que sobrar fica em usb_in_buffer para a próxima chamada.
+// Desiste com -ETIMEDOUT quando deadline passa, mesmo que o dispositivo continue mandando pedaços de linha.
+static int usb_read_line(char *line, ktime_t deadline) {
+    int ret, actual_size, timeout_ms;
+
+    while (true) {
+        while (usb_in_pos < usb_in_len) {
+            char c = usb_in_buffer[usb_in_pos++];
+            if (c == '\r')
+                continue;
+            if (c == '\n') {
+                recv_line[recv_len] = '\0';
+                strscpy(line, recv_line, MAX_RECV_LINE);
+                recv_len = 0;
+                return 0;
+            }
+            if (recv_len < MAX_RECV_LINE - 1)
+                recv_line[recv_len++] = c;
+        }
+
+        // usb_bulk_msg com timeout 0 espera para sempre: nunca passe 0 adiante
+        timeout_ms = deadline_remaining_ms(deadline);
+        if (!timeout_ms)
+            return -ETIMEDOUT;
+
+        // Lê os dados da porta serial e armazena em usb_in_buffer
+        ret = usb_bulk_msg(smartlamp_device, usb_rcvbulkpipe(smartlamp_device, usb_in), usb_in_buffer, usb_max_size, &actual_size, timeout_ms);
+        if (ret)
+            return ret;
+        usb_in_pos = 0;
+        usb_in_len = actual_size;
     }
+}
 
-    sprintf(resp_expected, "RES %s", cmd);  // Resposta esperada. Ficará lendo linhas até receber essa resposta.
+// Descarta tudo o que o firmware já tinha enviado (mensagens de boot, respostas atrasadas)
+static void usb_flush_input(void) {
+    int i, actual_size;
 
-    return usb_read_serial(param);
+    usb_in_pos = usb_in_len = 0;
+    recv_len = 0;
+    usb_stale_input = false;
+    for (i = 0; i < FLUSH_MAX_PACKETS; i++) {
+        if (usb_bulk_msg(smartlamp_device, usb_rcvbulkpipe(smartlamp_device, usb_in), usb_in_buffer, usb_max_size, &actual_size, FLUSH_TIMEOUT_MS))
+            break;
+    }
 }
 
-static int usb_read_serial(int mode) {
-    int ret, actual_size;
-    int retries = 10;                       // Tenta algumas vezes receber uma resposta da USB. Depois desiste.
-    long ldr_value; 
-    char prefix[20];
-    if (mode == 1)
-        strcpy(prefix,"RES GET_LDR ");
-    else if (mode == 2)
-        strcpy(prefix,"RES GET_LED ");
-    else if (mode == 3)
-        strcpy(prefix,"RES SET_LED ");
-    else if (mode == 4)
-        strcpy(prefix,"RES GET_TEMP ");
-    else if (mode == 5)
-        strcpy(prefix,"RES GET_HUM ");
-
-    const size_t prefix_len = strlen(prefix);
-
-    // Espera pela resposta correta do dispositivo (desiste depois de várias tentativas)
-    while (retries > 0) {
-        // Lê os dados da porta serial e armazena em usb_in_buffer
-            // usb_in_buffer - contem a resposta em string do dispositivo
-            // actual_size - contem o tamanho da resposta em bytes
-        char buffer[64];
-        bool endloop = false;
-        int bufferIdx = 0;
-        while (!endloop) {
-            ret = usb_bulk_msg(smartlamp_device, usb_rcvbulkpipe(smartlamp_device, usb_in), usb_in_buffer, min(usb_max_size, MAX_RECV_LINE), &actual_size, 1000);
-            if (ret) {
-                endloop = true;
-                bufferIdx = 0;
-                continue;
+// Envia HELLO e espera "RES HELLO <versao> <sensores> <recursos>".
+// O HELLO é reenviado algumas vezes porque o ESP32 pode ainda estar no boot quando o probe acontece.
+static int smartlamp_handshake(void) {
+    char line[MAX_RECV_LINE];
+    int ret, version, sensors, features;
+    unsigned int wait_ms = HELLO_TIMEOUT_MS;
+    ktime_t start = ktime_get();
+    ktime_t window = ktime_add_ms(start, HELLO_WINDOW_MS);
+
+    usb_flush_input();
+    while (ktime_before(ktime_get(), window)) {
+        ktime_t deadline = ktime_add_ms(ktime_get(), wait_ms);
+
+        wait_ms = min(wait_ms * 2, (unsigned int)HELLO_MAX_WAIT_MS);
+
+        ret = usb_write_cmd("HELLO", deadline);
+        if (ret == -ETIMEDOUT)
+            continue;
+        if (ret)
+            return ret;
+        // Descarta a tagarelice do boot até chegar a resposta ou estourar o timeout
+        while (usb_read_line(line, deadline) == 0) {
+            if (sscanf(line, "RES HELLO %d %d %d", &version, &sensors, &features) == 3) {
+                fw_version = version;
+                fw_sensors = sensors & SENSOR_ALL;
+                caps_pending = sensors & SENSOR_PENDING;
+                fw_features = features;
+                handshake_us = ktime_us_delta(ktime_get(), start);
+                printk(KERN_INFO "SmartLamp: Firmware v%d, sensores 0x%x, recursos 0x%x (handshake em %lld us)\n",
+                       fw_version, fw_sensors, fw_features, handshake_us);
+                usb_flush_input(); // Respostas aos HELLOs reenviados durante o boot
+                return 0;
             }
-            if (usb_in_buffer[0] != '\n')  {
-                buffer[bufferIdx] = usb_in_buffer[0];
-                bufferIdx++;
-                continue;
-            } else {
-                buffer[bufferIdx] = '\0';
-                endloop = true;
-                continue;
+            if (strncmp(line, "ERR", 3) == 0) {
+                usb_flush_input();
+                return -EOPNOTSUPP; // Firmware antigo: não conhece o HELLO
             }
-            bufferIdx = 0;
-        }
-        
-        if (ret) {
-            printk(KERN_ERR "SmartLamp: Erro ao ler dados da USB (tentativa %d). Codigo: %d\n", retries--, ret);
-            continue;
         }
-        printk("value %s\n", buffer);
+    }
+
+    usb_stale_input = true;                 // Firmware antigo ainda pode responder aos HELLOs depois do prazo
+    return -ETIMEDOUT;
+}
 
-        //usb_in_buffer[actual_size] = '\0';
+static int __usb_send_cmd(const char *cmd, int *value, ktime_t *when);
+static void breaker_record(int ret);
+static bool time_sync_to_host(s64 dev_ns, ktime_t *when);
 
-        //caso tenha recebido a mensagem 'RES_LDR X' via serial acesse o buffer 'usb_in_buffer' e retorne apenas o valor da resposta X
-        //retorne o valor de X em inteiro
-         if (strncmp(buffer, prefix, prefix_len) == 0) {
+static int usb_send_cmd(const char *cmd, int *value) {
+    return usb_send_cmd_ts(cmd, value, NULL);
+}
 
-            if (kstrtol(buffer + prefix_len, 10, &ldr_value) == 0) {
-                // A conversão funcionou.
-                printk(KERN_INFO "SmartLamp: Mensagem recebida: '%s', Valor LDR extraído: %ld\n", usb_in_buffer, ldr_value);
-                return (int)ldr_value; // Retorna o valor como um inteiro
-            } else {
-                // A conversão falhou
-                printk(KERN_WARNING "SmartLamp: Mensagem com prefixo correto, mas valor LDR inválido: '%s'\n", usb_in_buffer);
+// Envia um comando via USB, espera e retorna a resposta do dispositivo (convertida para int) em value
+// Exemplo de Comando:  SET_LED 80
+// Exemplo de Resposta: RES SET_LED 1
+// Exemplo de chamada da função usb_send_cmd para SET_LED: usb_send_cmd("SET_LED 80", &value);
+// Depois do TIME_SYNC as amostras chegam como "RES GET_LDR <valor> <instante em us no ESP32>";
+// when recebe esse instante convertido para o host (ou o instante da resposta, se não houver carimbo).
+static int usb_send_cmd_ts(const char *cmd, int *value, ktime_t *when) {
+    int ret;
+
+    // Com o circuito aberto nem espera pelo mutex: quem chamar falha na hora
+    if (READ_ONCE(breaker_open))
+        return -EIO;
+
+    mutex_lock(&usb_mutex);
+    if (breaker_open) {
+        mutex_unlock(&usb_mutex);
+        return -EIO;
+    }
+    ret = __usb_send_cmd(cmd, value, when);
+    breaker_record(ret == -ENODATA ? 0 : ret); // Valor inválido é falha do sensor, não do enlace
+    mutex_unlock(&usb_mutex);
+    return ret;
+}
+
+// Contabiliza o resultado de um comando e abre o circuito depois de falhas seguidas. Chamado com usb_mutex.
+static void breaker_record(int ret) {
+    if (!ret) {
+        breaker_failures = 0;
+        return;
+    }
+    if (++breaker_failures < max(breaker_threshold, 1U) || breaker_open)
+        return;
+
+    printk(KERN_ERR "SmartLamp: Dispositivo nao responde apos %u falhas (ultimo erro %d), abrindo o circuito.\n",
+           breaker_failures, ret);
+    WRITE_ONCE(breaker_open, true);
+    smartlamp_nl_event(SMARTLAMP_EV_LINK_DOWN);
+    recovery_ms = max(cmd_timeout_ms, 100U);
+    schedule_delayed_work(&recovery_work, msecs_to_jiffies(recovery_ms));
+}
+
+// Tenta falar com o dispositivo enquanto o circuito está aberto, com intervalo crescente entre as tentativas
+static void recovery_work_fn(struct work_struct *work) {
+    int value, ret;
+
+    mutex_lock(&usb_mutex);
+    ret = __usb_send_cmd("GET_LED", &value, NULL); // Descarta antes as respostas atrasadas dos comandos que falharam
+    if (!ret) {
+        breaker_failures = 0;
+        WRITE_ONCE(breaker_open, false);
+    }
+    mutex_unlock(&usb_mutex);
+
+    if (!ret) {
+        printk(KERN_INFO "SmartLamp: Dispositivo voltou a responder, fechando o circuito.\n");
+        smartlamp_nl_event(SMARTLAMP_EV_LINK_UP);
+        return;
+    }
+    recovery_ms = min(recovery_ms * 2, (unsigned int)RECOVERY_MAX_MS);
+    schedule_delayed_work(&recovery_work, msecs_to_jiffies(recovery_ms));
+}
+
+// Prazo total do comando: os comandos do DHT11 precisam de mais tempo que os demais, e o firmware
+// sem FEATURE_LINE_CMDS só responde depois que o timeout da sua serial expira
+static unsigned int cmd_budget_ms(const char *cmd) {
+    unsigned int budget = max(cmd_timeout_ms, 10U);
+
+    if (strncmp(cmd, "GET_TEMP", 8) == 0 || strncmp(cmd, "GET_HUM", 7) == 0)
+        budget = max(cmd_timeout_ms, (unsigned int)DHT_TIMEOUT_MS);
+    if (!(fw_features & FEATURE_LINE_CMDS))
+        budget += SERIAL_TIMEOUT_MS;
+    return budget;
+}
+
+static int __usb_send_cmd(const char *cmd, int *value, ktime_t *when) {
+    int ret, n;
+    long long dev_us;
+    char line[MAX_RECV_LINE];
+    char resp_expected[MAX_RECV_LINE];      // Resposta esperada do comando
+    size_t resp_len;
+    ktime_t deadline;
+
+    // A resposta atrasada de um comando que estourou o prazo começa com o mesmo prefixo
+    // e seria tomada como a resposta deste; descarta antes de escrever
+    if (usb_stale_input)
+        usb_flush_input();
+
+    deadline = ktime_add_ms(ktime_get(), cmd_budget_ms(cmd));
+    ret = usb_write_cmd(cmd, deadline);
+    if (ret) {
+        usb_stale_input = true;
+        return ret;
+    }
+
+    // Resposta esperada: "RES " seguido da primeira palavra do comando. Ficará lendo linhas até receber essa resposta.
+    snprintf(resp_expected, sizeof(resp_expected), "RES %.*s ", (int)strcspn(cmd, " "), cmd);
+    resp_len = strlen(resp_expected);
+
+    // Espera pela resposta correta do dispositivo até o prazo do comando acabar
+    while (true) {
+        ret = usb_read_line(line, deadline);
+        if (ret) {
+            printk(KERN_ERR "SmartLamp: Sem resposta valida para %s. Codigo: %d\n", cmd, ret);
+            usb_stale_input = true;
+            return ret;
+        }
+
+        if (strncmp(line, resp_expected, resp_len) == 0) {
+            n = sscanf(line + resp_len, "%d %lld", value, &dev_us);
+            if (n >= 1) {
+                if (when && !(n == 2 && time_sync_to_host(dev_us * NSEC_PER_USEC, when)))
+                    *when = ktime_get();
+                if (first_read_us < 0) {
+                    first_read_us = ktime_us_delta(ktime_get(), probe_start);
+                    printk(KERN_INFO "SmartLamp: Primeira leitura valida %lld us apos a conexao\n", first_read_us);
+                }
+                return 0;
             }
+            // O dispositivo respondeu, mas o sensor falhou (e.g., "RES GET_TEMP nan" com o DHT com defeito):
+            // não adianta esperar o resto do prazo, e a entrada não ficou com resposta pendente
+            pr_debug("SmartLamp: Mensagem com prefixo correto, mas valor invalido: '%s'\n", line);
+            return -ENODATA;
         }
 
         // Se a mensagem não era a esperada, apenas ignora e tenta ler a próxima.
-        retries--;
     }
-
-    printk(KERN_ERR "SmartLamp: Nao foi possivel ler um valor LDR valido apos 10 tentativas.\n");
-    return -1; 
 }
 
 // Executado quando o arquivo /sys/kernel/smartlamp/{led, ldr} é lido (e.g., cat /sys/kernel/smartlamp/led)
 static ssize_t attr_show(struct kobject *sys_obj, struct kobj_attribute *attr, char *buff) {
     // value representa o valor do led ou ldr
     int value = -1;
+    int ret = -EINVAL;
+    int sensor = -1;
+    ktime_t when;
     // attr_name representa o nome do arquivo que está sendo lido (ldr ou led)
     const char *attr_name = attr->attr.name;
 
@@ -251,15 +789,59 @@ static ssize_t attr_show(struct kobject *sys_obj, struct kobj_attribute *attr, c
 
     // Implemente a leitura do valor do led ou ldr usando a função usb_send_cmd()
     if (strcmp(attr_name,"ldr") == 0)
-        value = usb_send_cmd("GET_LDR",1);
+        sensor = STAT_LDR;
     else if (strcmp(attr_name,"led") == 0)
-        value = usb_send_cmd("GET_LED",2);
+        ret = usb_send_cmd("GET_LED", &value);
     else if (strcmp(attr_name,"temp") == 0)
-        value = usb_send_cmd("GET_TEMP",4);
+        sensor = STAT_TEMP;
     else if (strcmp(attr_name,"hum") == 0)
-        value = usb_send_cmd("GET_HUM",5);
-    sprintf(buff, "%d\n", value);                   // Cria a mensagem com o valor do led, ldr
-    return strlen(buff);
+        sensor = STAT_HUM;
+
+    if (sensor >= 0) {
+        ret = usb_send_cmd_ts(sensor_table[sensor].cmd, &value, &when);
+        if (!ret) {
+            stats_set_last(sensor, value, when);
+            smartlamp_nl_sample(sensor_table[sensor].name, value, when);
+        } else if (serve_stale && stats_get_last(sensor, &value) == 0)
+            ret = 0;            // Dispositivo não respondeu: devolve o último valor conhecido
+    }
+    if (ret)
+        return ret;
+    return sprintf(buff, "%d\n", value);            // Cria a mensagem com o valor do led, ldr
+}
+
+// Estado da sincronização: "<offset_ns> <drift_ppb> <rtt_ns>", ou "unsynced"
+static ssize_t time_sync_show(char *buff) {
+    struct time_sync_state ts;
+
+    spin_lock(&time_sync_lock);
+    ts = time_sync_state;
+    spin_unlock(&time_sync_lock);
+    if (!ts.valid)
+        return sprintf(buff, "unsynced\n");
+    return sprintf(buff, "%lld %lld %lld\n", ts.offset_ns, ts.drift_ppb, ts.rtt_ns);
+}
+
+// Executado quando os arquivos informativos são lidos. Não geram tráfego na USB.
+static ssize_t info_show(struct kobject *sys_obj, struct kobj_attribute *attr, char *buff) {
+    const char *attr_name = attr->attr.name;
+
+    if (strcmp(attr_name, "fw_version") == 0)
+        return sprintf(buff, "%d\n", fw_version);
+    else if (strcmp(attr_name, "sensors") == 0)
+        return sprintf(buff, "%s%s%s\n", fw_sensors & SENSOR_LDR ? "ldr " : "",
+                       fw_sensors & SENSOR_TEMP ? "temp " : "", fw_sensors & SENSOR_HUM ? "hum" : "");
+    else if (strcmp(attr_name, "features") == 0)
+        return sprintf(buff, "0x%x\n", fw_features);
+    else if (strcmp(attr_name, "handshake_us") == 0)
+        return sprintf(buff, "%lld\n", handshake_us);
+    else if (strcmp(attr_name, "first_read_us") == 0)
+        return sprintf(buff, "%lld\n", first_read_us);
+    else if (strcmp(attr_name, "time_sync") == 0)
+        return time_sync_show(buff);
+    else if (strcmp(attr_name, "breaker") == 0)
+        return sprintf(buff, "%s %u\n", READ_ONCE(breaker_open) ? "open" : "closed", READ_ONCE(breaker_failures));
+    return -EINVAL;
 }
 
 
@@ -267,6 +849,7 @@ static ssize_t attr_show(struct kobject *sys_obj, struct kobj_attribute *attr, c
 // Executado quando o arquivo /sys/kernel/smartlamp/{led, ldr} é escrito (e.g., echo "100" | sudo tee -a /sys/kernel/smartlamp/led)
 static ssize_t attr_store(struct kobject *sys_obj, struct kobj_attribute *attr, const char *buff, size_t count) {
     long ret, value;
+    int result;
     const char *attr_name = attr->attr.name;
 
     // Converte o valor recebido para long
@@ -279,17 +862,485 @@ static ssize_t attr_store(struct kobject *sys_obj, struct kobj_attribute *attr,
     printk(KERN_INFO "SmartLamp: Setando %s para %ld ...\n", attr_name, value);
 
     // utilize a função usb_send_cmd para enviar o comando SET_LED X
-    char cmd[12] = "SET_LED ";
-    char number[4] = "";
-    sprintf(number,"%ld",value);
-    strcat(cmd,number);
-    //char test[] = "SET_LED 100";
-    ret = usb_send_cmd(cmd,3);
-
-    if (ret < 0) {
+    char cmd[24];
+    snprintf(cmd, sizeof(cmd), "SET_LED %ld", value);
+    ret = usb_send_cmd(cmd, &result);
+
+    if (ret || result < 0) {
         printk(KERN_ALERT "SmartLamp: erro ao setar o valor do %s.\n", attr_name);
         return -EACCES;
     }
+    smartlamp_nl_sample("led", value, ktime_get());
 
     return strlen(buff);
 }
+
+// Índice do balde que guarda o instante epoch (em unidades de bucket_s)
+static struct stat_bucket *stat_bucket(struct stat_window *w, u64 epoch) {
+    u32 idx;
+
+    div_u64_rem(epoch, STAT_BUCKETS, &idx);
+    return &w->buckets[idx];
+}
+
+// Descarta os baldes que saíram da janela até o instante epoch. Chamado com stats_lock.
+static void stat_window_advance(struct stat_window *w, u64 epoch) {
+    struct stat_bucket *b;
+    u64 steps, i;
+
+    if (epoch <= w->epoch)
+        return;
+
+    steps = min_t(u64, epoch - w->epoch, STAT_BUCKETS);
+    for (i = 1; i <= steps; i++) {
+        b = stat_bucket(w, w->epoch + i);
+        w->sum -= b->sum;
+        w->count -= b->count;
+        memset(b, 0, sizeof(*b));
+    }
+    w->epoch = epoch;
+
+    // Só aqui o mínimo/máximo precisa ser refeito, pois um balde pode ter levado o extremo embora
+    w->min = INT_MAX;
+    w->max = INT_MIN;
+    for (i = 0; i < STAT_BUCKETS; i++) {
+        b = &w->buckets[i];
+        if (!b->count)
+            continue;
+        w->min = min(w->min, b->min);
+        w->max = max(w->max, b->max);
+    }
+}
+
+static u64 stat_epoch(const struct stat_window *w, ktime_t when) {
+    // div_u64 recebe divisor u32: bucket_s * NSEC_PER_SEC (60e9 na janela de 1 h) seria truncado
+    return div_u64(div_u64(ktime_to_ns(when), NSEC_PER_SEC), w->bucket_s);
+}
+
+// Adiciona uma amostra do sensor em todas as janelas e na média exponencial
+static void stats_add(int sensor, int value, ktime_t when) {
+    struct sensor_stats *st = &stats[sensor];
+    struct stat_window *w;
+    struct stat_bucket *b;
+    int i;
+
+    spin_lock(&stats_lock);
+    for (i = 0; i < STAT_WINDOWS; i++) {
+        w = &st->win[i];
+        stat_window_advance(w, stat_epoch(w, when));
+        b = stat_bucket(w, w->epoch);
+        if (!b->count)
+            b->min = b->max = value;
+        b->min = min(b->min, value);
+        b->max = max(b->max, value);
+        b->sum += value;
+        b->count++;
+        if (!w->count)
+            w->min = w->max = value;
+        w->min = min(w->min, value);
+        w->max = max(w->max, value);
+        w->sum += value;
+        w->count++;
+    }
+    if (!st->has_ewma)
+        st->ewma = (s64)value << EWMA_FRAC;
+    st->ewma += (((s64)value << EWMA_FRAC) - st->ewma) >> EWMA_SHIFT;
+    st->has_ewma = true;
+    st->last = value;
+    st->last_ts = when;
+    st->has_last = true;
+    spin_unlock(&stats_lock);
+}
+
+static void stats_set_last(int sensor, int value, ktime_t when) {
+    spin_lock(&stats_lock);
+    stats[sensor].last = value;
+    stats[sensor].last_ts = when;
+    stats[sensor].has_last = true;
+    spin_unlock(&stats_lock);
+}
+
+static int stats_get_last(int sensor, int *value) {
+    int ret = -ENODATA;
+
+    spin_lock(&stats_lock);
+    if (stats[sensor].has_last) {
+        *value = stats[sensor].last;
+        ret = 0;
+    }
+    spin_unlock(&stats_lock);
+    return ret;
+}
+
+static void stats_reset(void) {
+    ktime_t now = ktime_get();
+    int i, j;
+
+    spin_lock(&stats_lock);
+    memset(stats, 0, sizeof(stats));
+    for (i = 0; i < STAT_SENSORS; i++) {
+        for (j = 0; j < STAT_WINDOWS; j++) {
+            stats[i].win[j].bucket_s = stat_bucket_s[j];
+            stats[i].win[j].epoch = stat_epoch(&stats[i].win[j], now);
+        }
+    }
+    spin_unlock(&stats_lock);
+}
+
+// Lê todos os sensores presentes, publica as amostras e reagenda a si mesmo a cada sample_period_ms()
+static void sample_work_fn(struct work_struct *work) {
+    int i, value, sensors = READ_ONCE(fw_sensors);
+    unsigned int period;
+    ktime_t when;
+
+    for (i = 0; i < STAT_SENSORS; i++) {
+        if (!(sensors & sensor_table[i].sensor))
+            continue;
+        if (usb_send_cmd_ts(sensor_table[i].cmd, &value, &when) == 0) {
+            stats_add(i, value, when);
+            smartlamp_nl_sample(sensor_table[i].name, value, when);
+        }
+    }
+
+    period = sample_period_ms();
+    if (period)
+        schedule_delayed_work(&sample_work, msecs_to_jiffies(period));
+}
+
+// Pergunta ao firmware quais sensores ele já detectou e cria os arquivos dos novos.
+// Os arquivos são criados antes de o sensor entrar em fw_sensors, que o sampler consulta.
+static void caps_work_fn(struct work_struct *work) {
+    int i, value, added;
+
+    if (usb_send_cmd("GET_CAPS", &value) == 0) {
+        added = value & SENSOR_ALL & ~fw_sensors;
+        for (i = 0; i < STAT_SENSORS; i++) {
+            if (!(added & sensor_table[i].sensor))
+                continue;
+            if (sys_obj && sysfs_create_group(sys_obj, sensor_table[i].group))
+                printk(KERN_ERR "SmartLamp: Falha ao criar os arquivos do sensor %s\n", sensor_table[i].cmd);
+        }
+        if (added) {
+            WRITE_ONCE(fw_sensors, fw_sensors | added);
+            printk(KERN_INFO "SmartLamp: Firmware detectou novos sensores 0x%x\n", added);
+        }
+        if (!(value & SENSOR_PENDING))
+            return;
+    }
+    if (++caps_polls < CAPS_MAX_POLLS)
+        schedule_delayed_work(&caps_work, msecs_to_jiffies(CAPS_POLL_MS));
+}
+
+// Executado quando as estatísticas são lidas. Não geram tráfego na USB.
+static ssize_t stat_show(struct kobject *sys_obj, struct kobj_attribute *attr, char *buff) {
+    struct stat_attribute *sa = container_of(attr, struct stat_attribute, attr);
+    struct sensor_stats *st = &stats[sa->sensor];
+    struct stat_window *w;
+    s64 value;
+
+    spin_lock(&stats_lock);
+    if (sa->kind == STAT_EWMA) {
+        if (!st->has_ewma)
+            goto no_data;
+        value = (st->ewma + (1 << (EWMA_FRAC - 1))) >> EWMA_FRAC;
+    } else if (sa->kind == STAT_TS) {
+        if (!st->has_last)
+            goto no_data;
+        value = ktime_to_ns(st->last_ts);
+    } else {
+        w = &st->win[sa->window];
+        stat_window_advance(w, stat_epoch(w, ktime_get()));
+        if (!w->count)
+            goto no_data;
+        if (sa->kind == STAT_MIN)
+            value = w->min;
+        else if (sa->kind == STAT_MAX)
+            value = w->max;
+        else
+            value = div_s64(w->sum, w->count);
+    }
+    spin_unlock(&stats_lock);
+    return sprintf(buff, "%lld\n", value);
+
+no_data:
+    spin_unlock(&stats_lock);
+    return -ENODATA;
+}
+
+// Uma troca TIME_SYNC: t0 e t3 são os instantes de envio e recepção no host. Chamado com usb_mutex.
+static int __time_sync_once(s64 *dev_ns, ktime_t *t0, ktime_t *t3) {
+    char line[MAX_RECV_LINE];
+    long long dev_us;
+    ktime_t deadline;
+    int ret;
+
+    *t0 = ktime_get();
+    deadline = ktime_add_ms(*t0, cmd_budget_ms("TIME_SYNC"));
+    ret = usb_write_cmd("TIME_SYNC", deadline);
+    while (!ret && (ret = usb_read_line(line, deadline)) == 0) {
+        if (sscanf(line, "RES TIME_SYNC %lld", &dev_us) == 1) {
+            *t3 = ktime_get();
+            *dev_ns = dev_us * NSEC_PER_USEC;
+            return 0;
+        }
+    }
+    usb_stale_input = true;
+    return ret;
+}
+
+// Acrescenta um ponto (dev_ns, host_ns) e reestima offset e deriva
+static void time_sync_update(s64 dev_ns, s64 host_ns, s64 rtt_ns) {
+    struct time_sync_state *ts = &time_sync_state;
+    s64 span, span_us, error_us, max_error_us;
+
+    spin_lock(&time_sync_lock);
+    // Relógio do ESP32 voltou para trás: o firmware reiniciou e a base antiga não vale mais
+    if (!ts->valid || dev_ns < ts->dev_last) {
+        ts->dev_ref = dev_ns;
+        ts->host_ref = host_ns;
+        ts->has_next = false;
+        ts->drift_ppb = 0;
+    }
+    // A base avança em saltos de meio limite, então o intervalo fica entre TIME_SYNC_MAX_SPAN / 2
+    // e TIME_SYNC_MAX_SPAN e a deriva continua medida sobre um intervalo longo
+    span = host_ns - ts->host_ref;
+    if (span > TIME_SYNC_MAX_SPAN && ts->has_next) {
+        ts->dev_ref = ts->dev_next;
+        ts->host_ref = ts->host_next;
+        ts->has_next = false;
+        span = host_ns - ts->host_ref;
+    }
+    if (span >= TIME_SYNC_MAX_SPAN / 2 && !ts->has_next) {
+        ts->dev_next = dev_ns;
+        ts->host_next = host_ns;
+        ts->has_next = true;
+    }
+    if (span >= TIME_SYNC_MIN_SPAN) {
+        // Em us e com o erro limitado à deriva máxima, o produto cabe com folga em 64 bits
+        span_us = div_s64(span, NSEC_PER_USEC);
+        max_error_us = div_s64(span_us, NSEC_PER_SEC / TIME_SYNC_MAX_DRIFT);
+        error_us = div_s64((dev_ns - ts->dev_ref) - span, NSEC_PER_USEC);
+        error_us = clamp_t(s64, error_us, -max_error_us, max_error_us);
+        ts->drift_ppb = div64_s64(error_us * NSEC_PER_SEC, span_us);
+    }
+    ts->dev_last = dev_ns;
+    ts->host_last = host_ns;
+    ts->offset_ns = dev_ns - host_ns;
+    ts->rtt_ns = rtt_ns;
+    ts->valid = true;
+    spin_unlock(&time_sync_lock);
+}
+
+// Faz TIME_SYNC_ROUNDS trocas no estilo NTP e usa a de menor ida e volta, cujo ponto médio é o mais confiável
+static int time_sync(void) {
+    s64 dev_ns, rtt, best_rtt = S64_MAX, best_dev = 0, best_host = 0;
+    ktime_t t0, t3;
+    int i, ret = 0;
+
+    mutex_lock(&usb_mutex);
+    if (breaker_open) {
+        mutex_unlock(&usb_mutex);
+        return -EIO;
+    }
+    usb_flush_input();                      // Uma resposta atrasada pareceria uma troca com ida e volta quase nula
+    for (i = 0; i < TIME_SYNC_ROUNDS; i++) {
+        ret = __time_sync_once(&dev_ns, &t0, &t3);
+        if (ret)
+            break;
+        rtt = ktime_to_ns(ktime_sub(t3, t0));
+        if (rtt < best_rtt) {
+            best_rtt = rtt;
+            best_dev = dev_ns;
+            best_host = ktime_to_ns(t0) + rtt / 2;
+        }
+    }
+    breaker_record(ret);
+    mutex_unlock(&usb_mutex);
+
+    if (best_rtt == S64_MAX) {
+        printk(KERN_WARNING "SmartLamp: Falha ao sincronizar o relogio do dispositivo. Codigo: %d\n", ret);
+        return ret;
+    }
+    time_sync_update(best_dev, best_host, best_rtt);
+    pr_debug("SmartLamp: TIME_SYNC offset %lld ns, deriva %lld ppb, rtt %lld ns\n",
+             best_dev - best_host, time_sync_state.drift_ppb, best_rtt);
+    return 0;
+}
+
+// Converte um instante do relógio do ESP32 para o CLOCK_MONOTONIC do host
+static bool time_sync_to_host(s64 dev_ns, ktime_t *when) {
+    struct time_sync_state *ts = &time_sync_state;
+    s64 delta;
+
+    spin_lock(&time_sync_lock);
+    if (!ts->valid) {
+        spin_unlock(&time_sync_lock);
+        return false;
+    }
+    delta = dev_ns - ts->dev_last;
+    // Em microssegundos para que delta * drift_ppb não estoure mesmo sem ressincronizar por dias
+    *when = ns_to_ktime(ts->host_last + delta - div_s64(div_s64(delta, NSEC_PER_USEC) * ts->drift_ppb, USEC_PER_SEC));
+    spin_unlock(&time_sync_lock);
+    return true;
+}
+
+static void time_sync_work_fn(struct work_struct *work) {
+    time_sync();
+    if (time_sync_ms)
+        schedule_delayed_work(&time_sync_work, msecs_to_jiffies(time_sync_ms));
+}
+
+// Recalcula o menor período pedido pelos assinantes. Chamado com rate_mutex.
+static void sampling_update_subscribers(void) {
+    struct rate_request *req;
+    unsigned int period = 0;
+
+    list_for_each_entry(req, &rate_requests, list) {
+        if (!period || req->period_ms < period)
+            period = req->period_ms;
+    }
+    WRITE_ONCE(subscriber_ms, period);
+}
+
+// Registra (ou cancela, com period_ms 0) o período pedido por um assinante netlink
+static int sampling_set_rate(u32 portid, unsigned int period_ms) {
+    struct rate_request *req, *tmp;
+    int ret = 0;
+
+    mutex_lock(&rate_mutex);
+    list_for_each_entry_safe(req, tmp, &rate_requests, list) {
+        if (req->portid != portid)
+            continue;
+        list_del(&req->list);
+        kfree(req);
+    }
+    if (period_ms) {
+        req = kzalloc(sizeof(*req), GFP_KERNEL);
+        if (!req) {
+            ret = -ENOMEM;
+        } else {
+            req->portid = portid;
+            req->period_ms = max(period_ms, (unsigned int)MIN_SAMPLE_MS);
+            list_add(&req->list, &rate_requests);
+        }
+    }
+    sampling_update_subscribers();
+    // Amostra já com o novo período em vez de esperar o agendamento antigo vencer
+    if (sampling && period_ms)
+        mod_delayed_work(system_wq, &sample_work, 0);
+    mutex_unlock(&rate_mutex);
+    return ret;
+}
+
+// Período efetivo: o menor entre o parâmetro sample_ms e os pedidos dos assinantes (0 = parado)
+static unsigned int sample_period_ms(void) {
+    unsigned int subs = READ_ONCE(subscriber_ms);
+    unsigned int param = READ_ONCE(sample_ms);
+
+    if (!param)
+        return subs;
+    if (!subs)
+        return param;
+    return min(param, subs);
+}
+
+// Aloca uma mensagem para o grupo multicast, ou NULL se ninguém estiver escutando
+static struct sk_buff *smartlamp_nl_new(u8 cmd, void **hdr) {
+    struct sk_buff *skb;
+
+    if (!genl_has_listeners(&smartlamp_genl_family, &init_net, 0))
+        return NULL;
+    skb = genlmsg_new(NLMSG_GOODSIZE, GFP_KERNEL);
+    if (!skb)
+        return NULL;
+    *hdr = genlmsg_put(skb, 0, 0, &smartlamp_genl_family, 0, cmd);
+    if (!*hdr || nla_put_string(skb, SMARTLAMP_A_DEVICE, smartlamp_dev_name)) {
+        nlmsg_free(skb);
+        return NULL;
+    }
+    return skb;
+}
+
+// Publica uma amostra para todos os assinantes: uma leitura na USB, qualquer número de ouvintes
+static void smartlamp_nl_sample(const char *sensor, int value, ktime_t when) {
+    struct sk_buff *skb;
+    void *hdr;
+
+    skb = smartlamp_nl_new(SMARTLAMP_C_SAMPLE, &hdr);
+    if (!skb)
+        return;
+    if (nla_put_string(skb, SMARTLAMP_A_SENSOR, sensor) ||
+        nla_put_s32(skb, SMARTLAMP_A_VALUE, value) ||
+        nla_put_u64_64bit(skb, SMARTLAMP_A_TIMESTAMP, ktime_to_ns(when), SMARTLAMP_A_PAD)) {
+        nlmsg_free(skb);
+        return;
+    }
+    genlmsg_end(skb, hdr);
+    genlmsg_multicast(&smartlamp_genl_family, skb, 0, 0, GFP_KERNEL);
+}
+
+// Publica uma mudança de estado (SMARTLAMP_EV_*)
+static void smartlamp_nl_event(u32 event) {
+    struct sk_buff *skb;
+    void *hdr;
+
+    skb = smartlamp_nl_new(SMARTLAMP_C_EVENT, &hdr);
+    if (!skb)
+        return;
+    if (nla_put_u32(skb, SMARTLAMP_A_EVENT, event) ||
+        nla_put_u64_64bit(skb, SMARTLAMP_A_TIMESTAMP, ktime_to_ns(ktime_get()), SMARTLAMP_A_PAD)) {
+        nlmsg_free(skb);
+        return;
+    }
+    genlmsg_end(skb, hdr);
+    genlmsg_multicast(&smartlamp_genl_family, skb, 0, 0, GFP_KERNEL);
+}
+
+// Executado quando um assinante envia SMARTLAMP_C_SET_RATE
+static int smartlamp_nl_set_rate(struct sk_buff *skb, struct genl_info *info) {
+    if (!info->attrs[SMARTLAMP_A_PERIOD_MS])
+        return -EINVAL;
+    return sampling_set_rate(info->snd_portid, nla_get_u32(info->attrs[SMARTLAMP_A_PERIOD_MS]));
+}
+
+// Quando o socket de um assinante é fechado, o pedido de período dele deixa de valer
+static int smartlamp_nl_notify(struct notifier_block *nb, unsigned long event, void *ptr) {
+    struct netlink_notify *n = ptr;
+
+    if (event == NETLINK_URELEASE && n->protocol == NETLINK_GENERIC)
+        sampling_set_rate(n->portid, 0);
+    return NOTIFY_DONE;
+}
+
+static int __init smartlamp_init(void) {
+    int ret;
+
+    ret = genl_register_family(&smartlamp_genl_family);
+    if (ret)
+        return ret;
+    ret = netlink_register_notifier(&smartlamp_nl_notifier);
+    if (ret)
+        goto err_family;
+    ret = usb_register(&smartlamp_driver);
+    if (ret)
+        goto err_notifier;
+    return 0;
+
+err_notifier:
+    netlink_unregister_notifier(&smartlamp_nl_notifier);
+err_family:
+    genl_unregister_family(&smartlamp_genl_family);
+    return ret;
+}
+
+static void __exit smartlamp_exit(void) {
+    struct rate_request *req, *tmp;
+
+    usb_deregister(&smartlamp_driver);
+    netlink_unregister_notifier(&smartlamp_nl_notifier);
+    genl_unregister_family(&smartlamp_genl_family);
+    list_for_each_entry_safe(req, tmp, &rate_requests, list) {
+        list_del(&req->list);
+        kfree(req);
+    }
+}
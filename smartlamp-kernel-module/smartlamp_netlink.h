@@ -0,0 +1,46 @@
+// Protocolo generic netlink do SmartLamp, compartilhado entre o driver e os programas que o escutam.
+//
+// O driver publica no grupo multicast SMARTLAMP_GENL_MCGRP cada amostra lida (SMARTLAMP_C_SAMPLE)
+// e cada mudança de estado (SMARTLAMP_C_EVENT). Um assinante pode pedir um período de amostragem
+// com SMARTLAMP_C_SET_RATE (exige CAP_NET_ADMIN); o driver amostra no menor período pedido entre
+// todos os assinantes.
+#ifndef SMARTLAMP_NETLINK_H
+#define SMARTLAMP_NETLINK_H
+
+#define SMARTLAMP_GENL_NAME    "SMARTLAMP"
+#define SMARTLAMP_GENL_VERSION 1
+#define SMARTLAMP_GENL_MCGRP   "samples"
+
+// Comandos
+enum {
+    SMARTLAMP_C_UNSPEC,
+    SMARTLAMP_C_SAMPLE,        // Driver -> assinantes: DEVICE, SENSOR, VALUE, TIMESTAMP
+    SMARTLAMP_C_EVENT,         // Driver -> assinantes: DEVICE, EVENT, TIMESTAMP
+    SMARTLAMP_C_SET_RATE,      // Assinante -> driver: PERIOD_MS (0 cancela o pedido); exige CAP_NET_ADMIN
+    __SMARTLAMP_C_MAX,
+};
+#define SMARTLAMP_C_MAX (__SMARTLAMP_C_MAX - 1)
+
+// Atributos
+enum {
+    SMARTLAMP_A_UNSPEC,
+    SMARTLAMP_A_DEVICE,        // string: nome do dispositivo USB (e.g., "1-1:1.0")
+    SMARTLAMP_A_SENSOR,        // string: "ldr", "temp", "hum" ou "led"
+    SMARTLAMP_A_VALUE,         // s32: valor lido
+    SMARTLAMP_A_TIMESTAMP,     // u64: instante da aquisição em ns no CLOCK_MONOTONIC do host
+    SMARTLAMP_A_EVENT,         // u32: SMARTLAMP_EV_*
+    SMARTLAMP_A_PERIOD_MS,     // u32: período de amostragem pedido
+    SMARTLAMP_A_PAD,
+    __SMARTLAMP_A_MAX,
+};
+#define SMARTLAMP_A_MAX (__SMARTLAMP_A_MAX - 1)
+
+// Eventos de mudança de estado
+enum {
+    SMARTLAMP_EV_CONNECTED,
+    SMARTLAMP_EV_DISCONNECTED,
+    SMARTLAMP_EV_LINK_DOWN,    // Circuito aberto: o dispositivo parou de responder
+    SMARTLAMP_EV_LINK_UP,      // Circuito fechado: o dispositivo voltou a responder
+};
+
+#endif
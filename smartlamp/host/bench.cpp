@@ -0,0 +1,153 @@
+// Microbenchmark do firmware no host: mede o custo de processCommand() e do caminho
+// completo de loop() (leitura da serial + trim + processamento) sem precisar do ESP32.
+//
+//   make bench              # roda com o número padrão de iterações
+//   ./build/bench 1000000   # ou escolha quantas iterações por caso
+
+#include "Arduino.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Definidos em smartlamp.ino
+void setup();
+void loop();
+void processCommand(String command);
+
+static long iterations = 200000;
+
+struct Sample {
+    double nsPerCmd;
+    double allocsPerCmd;
+    double bytesPerCmd;
+    long peak;
+};
+
+static double nowNs() {
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void report(const char *name, const Sample &s) {
+    printf("%-22s %10.1f ns/cmd %12.0f cmd/s %8.2f allocs/cmd %9.1f B/cmd %6ld B peak\n",
+           name, s.nsPerCmd, 1e9 / s.nsPerCmd, s.allocsPerCmd, s.bytesPerCmd, s.peak);
+}
+
+static Sample finish(double start, long count) {
+    double elapsed = nowNs() - start;
+    Sample s;
+    s.nsPerCmd = elapsed / count;
+    s.allocsPerCmd = (double)heapStats.allocs / count;
+    s.bytesPerCmd = (double)heapStats.bytes / count;
+    s.peak = heapStats.peak;
+    return s;
+}
+
+// processCommand() isolado; o String(cmd) equivale à linha que loop() montaria
+static void benchCommand(const char *name, const char *cmd) {
+    heapStatsReset();
+    double start = nowNs();
+    for (long i = 0; i < iterations; i++)
+        processCommand(String(cmd));
+    report(name, finish(start, iterations));
+}
+
+// Caminho completo: bytes chegando na serial até a resposta
+static void benchLoop(const char *name, const char *line) {
+    heapStatsReset();
+    double start = nowNs();
+    for (long i = 0; i < iterations; i++) {
+        Serial.feed(line);
+        loop();
+    }
+    report(name, finish(start, iterations));
+}
+
+static uint32_t rng = 0x12345678;
+
+static uint32_t nextRandom() {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+// Linhas aleatórias: comandos válidos, comandos mutados e lixo. Toda linha deve gerar
+// exatamente uma resposta começando com "RES " ou "ERR ".
+static int fuzz() {
+    static const char *tokens[] = { "GET_LDR", "GET_LED", "GET_TEMP", "GET_HUM", "SET_LED", "HELLO",
+                                    "TIME_SYNC", "GET_CAPS", " ", "  ", "-", "0", "100", "101", "-1", "99999999999",
+                                    "\t", "SET_LED ", "GET", "_", "x" };
+    const int ntokens = sizeof(tokens) / sizeof(tokens[0]);
+    char line[96];
+    long ok = 0, err = 0;
+
+    heapStatsReset();
+    long baseline = heapStats.live;         // As constantes String globais do firmware
+    double start = nowNs();
+    for (long i = 0; i < iterations; i++) {
+        size_t len = 0;
+        int parts = nextRandom() % 4;
+        for (int p = 0; p <= parts; p++) {
+            const char *t = tokens[nextRandom() % ntokens];
+            size_t n = strlen(t);
+            if (len + n >= sizeof(line) - 2)
+                break;
+            memcpy(line + len, t, n);
+            len += n;
+        }
+        // De vez em quando troca um byte por qualquer valor imprimível
+        if (len && nextRandom() % 4 == 0)
+            line[nextRandom() % len] = (char)(' ' + nextRandom() % 95);
+        line[len++] = '\n';
+        line[len] = '\0';
+
+        unsigned long before = Serial.lines();
+        Serial.feed(line);
+        loop();
+        if (Serial.lines() != before + 1) {
+            fprintf(stderr, "fuzz: %lu respostas para a linha '%.*s'\n", Serial.lines() - before, (int)len - 1, line);
+            return 1;
+        }
+        if (strncmp(Serial.lastLine(), "RES ", 4) == 0)
+            ok++;
+        else if (strncmp(Serial.lastLine(), "ERR ", 4) == 0)
+            err++;
+        else {
+            fprintf(stderr, "fuzz: resposta inesperada '%s'\n", Serial.lastLine());
+            return 1;
+        }
+    }
+    report("fuzz (loop)", finish(start, iterations));
+    printf("%-22s %ld RES, %ld ERR\n", "", ok, err);
+    if (heapStats.live != baseline) {
+        fprintf(stderr, "fuzz: %ld bytes ainda alocados\n", heapStats.live - baseline);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1)
+        iterations = atol(argv[1]);
+    if (iterations <= 0) {
+        fprintf(stderr, "uso: %s [iteracoes]\n", argv[0]);
+        return 2;
+    }
+
+    setup();
+    printf("%ld iteracoes por caso\n", iterations);
+
+    benchCommand("GET_LDR", "GET_LDR");
+    benchCommand("GET_LED", "GET_LED");
+    benchCommand("GET_TEMP", "GET_TEMP");
+    benchCommand("SET_LED 50", "SET_LED 50");
+    benchCommand("HELLO", "HELLO");
+    benchCommand("unknown", "FOO_BAR 1");
+    benchLoop("GET_LDR (loop)", "GET_LDR\n");
+    benchLoop("SET_LED 50 (loop)", "SET_LED 50\n");
+
+    return fuzz();
+}
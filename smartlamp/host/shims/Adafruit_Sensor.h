@@ -0,0 +1,6 @@
+#pragma once
+
+typedef struct {
+    float temperature;
+    float relative_humidity;
+} sensors_event_t;
@@ -0,0 +1,100 @@
+#include "Arduino.h"
+#include "DHT_U.h"
+#include "esp_timer.h"
+
+#include <chrono>
+
+HardwareSerial Serial;
+
+int shimAnalogValue = 512;
+int shimAnalogWritten = -1;
+unsigned long shimDelayMs = 0;
+float shimTemperature = 25.0f;
+float shimHumidity = 60.0f;
+
+void pinMode(int, int) {}
+
+int analogRead(int) {
+    return shimAnalogValue;
+}
+
+void analogWrite(int, int value) {
+    shimAnalogWritten = value;
+}
+
+void delay(unsigned long ms) {
+    shimDelayMs += ms;
+}
+
+// delay() não dorme no host, mas avança o relógio como faria no ESP32
+unsigned long millis() {
+    return (unsigned long)(esp_timer_get_time() / 1000) + shimDelayMs;
+}
+
+int64_t esp_timer_get_time() {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void HardwareSerial::begin(unsigned long) {}
+
+int HardwareSerial::available() {
+    return (int)(inLen_ - inPos_);
+}
+
+// Sem timeout no host: a entrada injetada já está inteira no buffer
+String HardwareSerial::readString() {
+    String out;
+    while (inPos_ < inLen_)
+        out.concat(in_[inPos_++]);
+    return out;
+}
+
+String HardwareSerial::readStringUntil(char terminator) {
+    String out;
+    while (inPos_ < inLen_) {
+        char c = in_[inPos_++];
+        if (c == terminator)
+            break;
+        out.concat(c);
+    }
+    return out;
+}
+
+int HardwareSerial::printf(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(last_, sizeof(last_), fmt, args);
+    va_end(args);
+    if (n > 0) {
+        bytesOut_ += n;
+        lines_++;
+    }
+    return n;
+}
+
+void HardwareSerial::feed(const char *data) {
+    // Descarta o que já foi consumido antes de acrescentar
+    if (inPos_ > 0) {
+        memmove(in_, in_ + inPos_, inLen_ - inPos_);
+        inLen_ -= inPos_;
+        inPos_ = 0;
+    }
+    size_t n = strlen(data);
+    if (n > sizeof(in_) - inLen_)
+        n = sizeof(in_) - inLen_;
+    memcpy(in_ + inLen_, data, n);
+    inLen_ += n;
+}
+
+const char *HardwareSerial::lastLine() const {
+    return last_;
+}
+
+unsigned long HardwareSerial::lines() const {
+    return lines_;
+}
+
+unsigned long HardwareSerial::bytesOut() const {
+    return bytesOut_;
+}
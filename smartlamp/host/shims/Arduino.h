@@ -0,0 +1,52 @@
+// Substitutos mínimos da API do Arduino para compilar o smartlamp.ino no Linux.
+// Só implementa o que o firmware usa; o comportamento segue o core do ESP32.
+#pragma once
+
+#include <math.h>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "WString.h"
+
+#define INPUT  0x01
+#define OUTPUT 0x03
+#define A0     36
+
+void pinMode(int pin, int mode);
+int  analogRead(int pin);
+void analogWrite(int pin, int value);
+void delay(unsigned long ms);
+unsigned long millis();
+
+// Serial com entrada injetada pelo benchmark e saída descartada (só contada)
+class HardwareSerial {
+public:
+    void begin(unsigned long baud);
+    int available();
+    String readString();
+    String readStringUntil(char terminator);
+    int printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+    // Usado apenas pelo host
+    void feed(const char *data);          // Acrescenta bytes à entrada
+    const char *lastLine() const;         // Última linha escrita pelo firmware
+    unsigned long lines() const;          // Quantidade de linhas escritas
+    unsigned long bytesOut() const;       // Bytes escritos
+
+private:
+    char in_[256];
+    size_t inLen_ = 0, inPos_ = 0;
+    char last_[128] = "";
+    unsigned long lines_ = 0, bytesOut_ = 0;
+};
+
+extern HardwareSerial Serial;
+
+// Valores simulados dos periféricos, ajustados pelo benchmark
+extern int shimAnalogValue;               // Valor devolvido por analogRead()
+extern int shimAnalogWritten;             // Último valor passado para analogWrite()
+extern unsigned long shimDelayMs;         // Soma dos delay() chamados
@@ -0,0 +1,4 @@
+#pragma once
+
+#define DHT11 11
+#define DHT22 22
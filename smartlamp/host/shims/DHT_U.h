@@ -0,0 +1,23 @@
+// DHT_Unified simulado: devolve shimTemperature/shimHumidity (NAN simula sensor ausente)
+#pragma once
+
+#include "Adafruit_Sensor.h"
+
+extern float shimTemperature;
+extern float shimHumidity;
+
+class DHT_Unified {
+public:
+    DHT_Unified(int pin, int type) { (void)pin; (void)type; }
+    void begin() {}
+
+    struct Temperature {
+        bool getEvent(sensors_event_t *event) { event->temperature = shimTemperature; return true; }
+    };
+    struct Humidity {
+        bool getEvent(sensors_event_t *event) { event->relative_humidity = shimHumidity; return true; }
+    };
+
+    Temperature temperature() { return Temperature(); }
+    Humidity humidity() { return Humidity(); }
+};
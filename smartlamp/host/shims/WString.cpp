@@ -0,0 +1,197 @@
+#include "WString.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+HeapStats heapStats;
+
+void heapStatsReset() {
+    long live = heapStats.live;
+    heapStats = HeapStats();
+    heapStats.live = live;
+    heapStats.peak = live;
+}
+
+void *shimRealloc(void *ptr, size_t oldSize, size_t newSize) {
+    void *p = realloc(ptr, newSize);
+    if (!p)
+        return nullptr;
+    heapStats.allocs++;
+    heapStats.bytes += newSize;
+    heapStats.live += (long)newSize - (long)oldSize;
+    if (heapStats.live > heapStats.peak)
+        heapStats.peak = heapStats.live;
+    return p;
+}
+
+void shimFree(void *ptr, size_t size) {
+    if (!ptr)
+        return;
+    free(ptr);
+    heapStats.frees++;
+    heapStats.live -= (long)size;
+}
+
+String::String(const char *cstr) {
+    if (cstr)
+        copy(cstr, strlen(cstr));
+}
+
+String::String(const String &other) {
+    *this = other;
+}
+
+String::String(String &&other) noexcept {
+    move(other);
+}
+
+String::~String() {
+    invalidate();
+}
+
+String &String::operator=(const String &other) {
+    if (this == &other)
+        return *this;
+    if (other.buffer())
+        copy(other.buffer(), other.len_);
+    else
+        invalidate();
+    return *this;
+}
+
+String &String::operator=(String &&other) noexcept {
+    if (this != &other)
+        move(other);
+    return *this;
+}
+
+// Como no core do ESP32: só cresce, e sempre com espaço para o '\0'
+bool String::reserve(unsigned int size) {
+    if (buffer() && capacity() >= size)
+        return true;
+    return changeBuffer(size);
+}
+
+// Tamanhos que cabem no buffer interno não alocam; os demais vão para o heap em múltiplos de 16
+bool String::changeBuffer(unsigned int maxStrLen) {
+    if (maxStrLen < SSO_SIZE - 1) {
+        if (!sso_ && heap_) {
+            char tmp[SSO_SIZE];
+            memcpy(tmp, heap_, maxStrLen);
+            shimFree(heap_, cap_ + 1);
+            heap_ = nullptr;
+            cap_ = 0;
+            memcpy(ssoBuf_, tmp, maxStrLen);
+        } else if (!sso_) {
+            ssoBuf_[0] = '\0';
+        }
+        sso_ = true;
+        return true;
+    }
+    size_t newSize = (maxStrLen + 16) & ~(size_t)0xf;
+    char *p;
+    if (sso_) {
+        p = (char *)shimRealloc(nullptr, 0, newSize);
+        if (p)
+            memcpy(p, ssoBuf_, len_ + 1);
+    } else {
+        p = (char *)shimRealloc(heap_, heap_ ? cap_ + 1 : 0, newSize);
+        if (p && !heap_)
+            p[0] = '\0';
+    }
+    if (!p)
+        return false;
+    sso_ = false;
+    heap_ = p;
+    cap_ = newSize - 1;
+    return true;
+}
+
+void String::copy(const char *cstr, unsigned int length) {
+    if (!reserve(length)) {
+        invalidate();
+        return;
+    }
+    len_ = length;
+    memmove(wbuffer(), cstr, length);
+    wbuffer()[len_] = '\0';
+}
+
+// Toma o buffer do heap da outra String; o buffer interno precisa ser copiado
+void String::move(String &other) {
+    invalidate();
+    if (other.sso_) {
+        memcpy(ssoBuf_, other.ssoBuf_, sizeof(ssoBuf_));
+        sso_ = true;
+    } else {
+        heap_ = other.heap_;
+        cap_ = other.cap_;
+    }
+    len_ = other.len_;
+    other.sso_ = false;
+    other.heap_ = nullptr;
+    other.cap_ = other.len_ = 0;
+}
+
+void String::invalidate() {
+    if (!sso_ && heap_)
+        shimFree(heap_, cap_ + 1);
+    sso_ = false;
+    heap_ = nullptr;
+    cap_ = len_ = 0;
+}
+
+bool String::equals(const String &other) const {
+    return len_ == other.len_ && strcmp(c_str(), other.c_str()) == 0;
+}
+
+int String::indexOf(char c, unsigned int fromIndex) const {
+    if (fromIndex >= len_)
+        return -1;
+    const char *p = strchr(buffer() + fromIndex, c);
+    return p ? (int)(p - buffer()) : -1;
+}
+
+String String::substring(unsigned int left, unsigned int right) const {
+    if (left > right) {
+        unsigned int tmp = left;
+        left = right;
+        right = tmp;
+    }
+    String out;
+    if (left >= len_)
+        return out;
+    if (right > len_)
+        right = len_;
+    out.copy(buffer() + left, right - left);
+    return out;
+}
+
+void String::trim() {
+    if (!buffer() || len_ == 0)
+        return;
+    char *buf = wbuffer();
+    char *begin = buf;
+    while (isspace((unsigned char)*begin))
+        begin++;
+    char *end = buf + len_ - 1;
+    while (end >= begin && isspace((unsigned char)*end))
+        end--;
+    len_ = end + 1 - begin;
+    if (begin > buf)
+        memmove(buf, begin, len_);
+    buf[len_] = '\0';
+}
+
+long String::toInt() const {
+    return buffer() ? atol(buffer()) : 0;
+}
+
+String &String::concat(char c) {
+    if (reserve(len_ + 1)) {
+        wbuffer()[len_++] = c;
+        wbuffer()[len_] = '\0';
+    }
+    return *this;
+}
@@ -0,0 +1,66 @@
+// String no estilo do core do ESP32 (cores/esp32/WString): strings de até 13 caracteres ficam no
+// próprio objeto (small string optimization) e os buffers no heap são arredondados para múltiplos
+// de 16 bytes. Toda alocação passa por shimRealloc/shimFree para que o benchmark conte o churn do heap.
+#pragma once
+
+#include <cstddef>
+
+struct HeapStats {
+    unsigned long allocs;                 // Chamadas que pediram memória nova ou maior
+    unsigned long frees;
+    unsigned long bytes;                  // Total de bytes pedidos (churn)
+    long live;                            // Bytes em uso agora
+    long peak;                            // Máximo de bytes em uso desde o último reset
+};
+
+extern HeapStats heapStats;
+void heapStatsReset();
+void *shimRealloc(void *ptr, size_t oldSize, size_t newSize);
+void shimFree(void *ptr, size_t size);
+
+class String {
+public:
+    String(const char *cstr = "");
+    String(const String &other);
+    String(String &&other) noexcept;
+    ~String();
+
+    String &operator=(const String &other);
+    String &operator=(String &&other) noexcept;
+
+    unsigned int length() const { return len_; }
+    const char *c_str() const { return buffer() ? buffer() : ""; }
+    char operator[](unsigned int index) const { return index < len_ ? buffer()[index] : 0; }
+
+    bool equals(const String &other) const;
+    bool operator==(const String &other) const { return equals(other); }
+    bool operator!=(const String &other) const { return !equals(other); }
+
+    int indexOf(char c, unsigned int fromIndex = 0) const;
+    String substring(unsigned int beginIndex) const { return substring(beginIndex, len_); }
+    String substring(unsigned int beginIndex, unsigned int endIndex) const;
+    void trim();
+    long toInt() const;
+
+    String &concat(char c);
+
+private:
+    // No ESP32 (32 bits) o buffer interno ocupa o espaço de {ponteiro, capacidade, tamanho} + 3 bytes
+    enum { SSO_SIZE = 15 };
+
+    const char *buffer() const { return sso_ ? ssoBuf_ : heap_; }
+    char *wbuffer() { return sso_ ? ssoBuf_ : heap_; }
+    unsigned int capacity() const { return sso_ ? SSO_SIZE - 1 : cap_; }
+
+    bool reserve(unsigned int size);
+    bool changeBuffer(unsigned int maxStrLen);
+    void copy(const char *cstr, unsigned int length);
+    void move(String &other);
+    void invalidate();
+
+    char ssoBuf_[SSO_SIZE];
+    bool sso_ = false;
+    char *heap_ = nullptr;
+    unsigned int cap_ = 0;
+    unsigned int len_ = 0;
+};
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstdint>
+
+// Microssegundos desde o início do processo, como o esp_timer do ESP32 conta desde o boot
+int64_t esp_timer_get_time();
@@ -1,12 +1,31 @@
 #include <Adafruit_Sensor.h>
 #include <DHT.h>
 #include <DHT_U.h>
+#include <esp_timer.h>
 
 
 #define DHTPIN 14 
 #define DHTTYPE    DHT11     // DHT 11
+
+// Versão do protocolo e capacidades anunciadas na resposta do HELLO
+#define FW_VERSION        3
+#define SENSOR_LDR        (1 << 0)
+#define SENSOR_TEMP       (1 << 1)
+#define SENSOR_HUM        (1 << 2)
+#define SENSOR_PENDING    (1 << 7) // Detecção do DHT em andamento: o driver consulta de novo com GET_CAPS
+#define FEATURE_LINE_CMDS (1 << 0) // Comandos terminados em '\n' são respondidos imediatamente
+#define FEATURE_TIME_SYNC (1 << 1) // Responde TIME_SYNC e carimba as amostras com o instante da aquisição
+#define DHT_SETTLE_MS     1000     // O DHT11 precisa de ~1 s depois de energizado para responder
+#define DHT_INTERVAL_MS   2000     // Intervalo mínimo entre leituras reais do DHT11
 float temp = 0;
 float hum = 0;
+int64_t dhtStamp = 0;       // Instante (esp_timer, em us) da última leitura real do DHT
+unsigned long dhtLastMs = 0;
+bool dhtEverRead = false;
+int dhtSensors = 0;          // Sensores do DHT detectados até agora (SENSOR_TEMP e/ou SENSOR_HUM)
+int dhtAttempts = 0;         // Leituras feitas pela detecção do DHT
+bool dhtDetecting = true;    // A detecção termina com os dois sensores achados ou depois de duas leituras
+bool stampSamples = false;  // Ligado pelo primeiro TIME_SYNC: só drivers que sincronizam recebem os carimbos
 DHT_Unified dht(DHTPIN, DHTTYPE);
 
 
@@ -27,6 +46,9 @@ const String GET_LED = "GET_LED";
 const String GET_LDR = "GET_LDR";
 const String GET_TEMP = "GET_TEMP";
 const String GET_HUM = "GET_HUM";
+const String HELLO = "HELLO";
+const String TIME_SYNC = "TIME_SYNC";
+const String GET_CAPS = "GET_CAPS";
 
 
 
@@ -40,8 +62,16 @@ int ldrGetValue() {
 }
 
 
+// O DHT11 só faz uma nova aquisição a cada 2 s (a biblioteca devolve o valor em cache antes disso):
+// dentro desse intervalo temp, hum e dhtStamp continuam os da última leitura real
 void readDht11() {
   sensors_event_t event;
+  unsigned long now = millis();
+  if (dhtEverRead && now - dhtLastMs < DHT_INTERVAL_MS)
+    return;
+  dhtEverRead = true;
+  dhtLastMs = now;
+  dhtStamp = esp_timer_get_time();
   dht.temperature().getEvent(&event);
   temp = event.temperature;
 
@@ -49,6 +79,43 @@ void readDht11() {
   hum = event.relative_humidity;
 }
 
+// Detecta o DHT a partir do loop(), sem bloquear: a primeira leitura espera o tempo de
+// estabilização do sensor e uma leitura inválida é repetida uma vez antes de o sensor ser
+// dado como ausente. Enquanto isso o HELLO já responde, anunciando SENSOR_PENDING.
+void detectDht() {
+    unsigned long now = millis();
+    if (!dhtDetecting || now < DHT_SETTLE_MS)
+        return;
+    if (dhtAttempts > 0 && now - dhtLastMs < DHT_INTERVAL_MS)
+        return;
+    dhtAttempts++;
+    readDht11();
+    if (!isnan(temp))
+        dhtSensors |= SENSOR_TEMP;
+    if (!isnan(hum))
+        dhtSensors |= SENSOR_HUM;
+    if (dhtSensors == (SENSOR_TEMP | SENSOR_HUM) || dhtAttempts >= 2)
+        dhtDetecting = false;
+}
+
+int sensors() {
+    return SENSOR_LDR | dhtSensors | (dhtDetecting ? SENSOR_PENDING : 0);
+}
+
+// Responde ao handshake do driver com a versão, os sensores presentes e os recursos do protocolo.
+// O DHT só é anunciado depois de detectado; até lá a resposta leva SENSOR_PENDING.
+void hello() {
+    Serial.printf("RES HELLO %d %d %d\n", FW_VERSION, sensors(), FEATURE_LINE_CMDS | FEATURE_TIME_SYNC);
+}
+
+// Envia o valor de um sensor; depois do TIME_SYNC acrescenta o instante da aquisição em us
+void sendSample(const String &cmd, float value, int64_t stamp) {
+    if (stampSamples)
+        Serial.printf("RES %s %.0f %lld\n", cmd.c_str(), value, (long long)stamp);
+    else
+        Serial.printf("RES %s %.0f\n", cmd.c_str(), value);
+}
+
 int getLedNormalizedVal(int val) {
     return ((float)val/100)*255;
 }
@@ -78,18 +145,31 @@ void processCommand(String command) {
         cmd = command;
     }
     if (cmd == GET_LDR) {
-        Serial.printf("RES GET_LDR %d\n", ldrGetValue());
+        int ldr = ldrGetValue();
+        sendSample(GET_LDR, ldr, esp_timer_get_time());
         return;
     } else if (cmd == GET_LED) {
         Serial.printf("RES GET_LED %d\n", ledVal);
         return;
     } else if (cmd == GET_TEMP) {
         readDht11();
-        Serial.printf("RES GET_TEMP %.0f\n", temp);
+        sendSample(GET_TEMP, temp, dhtStamp);
         return;
     } else if (cmd == GET_HUM) {
         readDht11();
-        Serial.printf("RES GET_HUM %.0f\n", hum);
+        sendSample(GET_HUM, hum, dhtStamp);
+        return;
+    } else if (cmd == TIME_SYNC) {
+        // Carimbo tirado o mais perto possível da chegada do comando; o driver compensa a ida e volta
+        int64_t now = esp_timer_get_time();
+        stampSamples = true;
+        Serial.printf("RES TIME_SYNC %lld\n", (long long)now);
+        return;
+    } else if (cmd == HELLO) {
+        hello();
+        return;
+    } else if (cmd == GET_CAPS) {
+        Serial.printf("RES GET_CAPS %d\n", sensors());
         return;
     } else if (cmd == SET_LED && command.length() >= 9) {
         String val = command.substring(8);
@@ -103,6 +183,7 @@ void processCommand(String command) {
 void setup() {
     Serial.begin(9600);
 
+    dht.begin();
     pinMode(ledPin, OUTPUT);
     pinMode(ldrPin, INPUT);
     analogWrite(ledPin,getLedNormalizedVal(ledVal));
@@ -115,10 +196,12 @@ void loop() {
     //Obtenha os comandos enviados pela serial 
     //e processe-os com a função processCommand
     //processCommand(GET_LDR);
+    // O driver termina cada comando com '\n': ler até ele evita esperar o timeout da serial
     if (Serial.available() > 0) {
-        String command = Serial.readString();
+        String command = Serial.readStringUntil('\n');
         command.trim();
         processCommand(command);
     }
-    delay(100);
+    detectDht();
+    delay(1);
 }
\ No newline at end of file